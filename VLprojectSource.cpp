@@ -10,20 +10,59 @@
 
 #include "shader.h"
 
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
 
 #include "cylinder.h"
+#include "meshcache.h"
+#include "primitives.h"
+#include "instancedmesh.h"
+#include "textureloader.h"
+#include "texturearray.h"
+#include "camerauniforms.h"
+#include "renderqueue.h"
+#include "bounds.h"
+#include "bvh.h"
+#include "lod.h"
+#include "headless.h"
+#include "camerarecording.h"
+#include "frametimestats.h"
+#include "profiler.h"
+#include "scene.h"
+#include "meshbuilder.h"
+#include "staticbatch.h"
+#include "gpuculling.h"
+#include "clusteredlights.h"
+#include "transformhierarchy.h"
+#include "framesnapshot.h"
+#include "jobsystem.h"
+#include "forest.h"
+#include "streambuffer.h"
+#include "framecapture.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
-unsigned int loadTexture(const char* path);
+GLFWwindow* createWindow();
+void parseArguments(int argc, char** argv);
+float getTime();
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
+// current framebuffer size, kept up to date by framebuffer_size_callback
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
+
 // camera
 glm::vec3 cameraPos = glm::vec3(0.0f, 0.0f, 3.0f);
 glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -3.0f);
@@ -42,117 +81,196 @@ float fov = 45.0f;
 float deltaTime = 0.0f;	// time between current frame and last frame
 float lastFrame = 0.0f;
 
-// lighting
-glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
+// frame time statistics, averaged and printed every few seconds
+float frameTimeTotal = 0.0f;
+int frameTimeSamples = 0;
+float frameTimeReportStart = 0.0f;
+
+// profiler (--profile, --trace FILE): CPU sections and GPU draw groups, shown in the
+// window title and optionally written to a Chrome trace
+bool profiling = false;
+std::string traceFile;
+float profileReportStart = 0.0f;
+
+// lighting: with --lights N the lit programs shade N moving point lights through a
+// clustered light grid at night; 0 keeps the unlit daylight look
+int pointLightCount = 0;
 
 //switch to orthographic view
 bool isOrtho = false;
 
-int main()
+// headless mode (--headless): render offscreen without a window for a fixed number of
+// frames, optionally along a scripted camera path, and write the frames out (--output DIR,
+// --no-output)
+bool headless = false;
+int headlessWidth = SCR_WIDTH;
+int headlessHeight = SCR_HEIGHT;
+int headlessFrames = 100;
+std::string cameraPathFile;
+std::string frameOutputDir = "frames";
+bool writeFrames = true;
+
+// frame capture (--capture DIR or FILE.y4m): frames are read back through pixel buffer
+// objects and written by background threads as a PPM sequence or a Y4M video at
+// --capture-fps. when --capture-queue frames wait to be written the renderer waits too.
+// headless runs capture into their output directory unless --capture is given
+std::string captureTarget;
+int captureFps = 60;
+int captureQueue = 8;
+
+// scene file (--scene); --compile-scene only compiles it to its binary form and exits
+std::string sceneFile = "scenefiles/park.scene";
+bool compileSceneOnly = false;
+
+// merge static scene objects into one draw per program and texture (--no-batching turns it off)
+bool staticBatching = true;
+
+// cull and draw the lit scene file objects on the GPU (--gpu-culling), needs OpenGL 4.3
+bool gpuCulling = false;
+
+// sway the trees (--sway-trees); each tree is a small transform hierarchy, so only the
+// roots are set and their trunks and canopies follow
+bool swayingTrees = false;
+
+// per-draw model matrices and texture layers of the lit program go through a fenced ring
+// buffer, persistently mapped where the driver allows, instead of uniform calls
+// (--no-stream-buffer turns it off)
+bool streamBuffers = true;
+
+// threads for the frame's CPU work, counting the main thread (--jobs N); 0 uses every core
+int jobThreads = 0;
+
+// simulate on the main thread and draw on a render thread of its own (--render-thread);
+// the simulation then runs at a fixed rate and the renderer draws its newest snapshot
+bool renderThread = false;
+const float SIMULATION_STEP = 1.0f / 250.0f;
+
+// procedural forest (--forest N): N trees scattered around the park with Poisson-disk
+// spacing, culled and streamed by grid cell within --forest-distance of the camera. the
+// square they cover grows with N at one tree per 25 square units unless --forest-area
+// sets its side. --forest-benchmark renders headless with 1000, 10000, ... trees up to N
+// (a million by default), --frames frames each, and reports the frame times of each count
+int forestTrees = 0;
+float forestArea = 0.0f;
+float forestDistance = 100.0f;
+bool forestBenchmark = false;
+
+// linked shader programs are cached here (--shader-cache DIR, --no-shader-cache)
+std::string shaderCacheDir = "shadercache";
+
+// camera recording (--record) and deterministic replay (--replay) at a fixed timestep
+std::string recordFile;
+std::string replayFile;
+float replayTimestep = 0.0f;	// 0 keeps the timestep stored in the recording
+
+int main(int argc, char** argv)
 {
-	// glfw: initialize and configure
-	// ------------------------------
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-#ifdef __APPLE__
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
-
-	// glfw window creation
-	// --------------------
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-	if (window == NULL)
+	parseArguments(argc, argv);
+	if (forestBenchmark)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
+		headless = true;
+		writeFrames = false;
+		headlessFrames = std::max(headlessFrames, 2);
+		if (forestTrees <= 0)
+			forestTrees = Forest::MAX_TREES;
+	}
+	if (compileSceneOnly)
+		return scene_format::compile(sceneFile, scene_format::binaryPath(sceneFile)) ? 0 : -1;
+
+	// create the OpenGL context: a GLFW window, or a surfaceless EGL context rendering
+	// into an offscreen framebuffer in headless mode
+	// ---------------------------------------------------------------------------------
+	GLFWwindow* window = NULL;
+	HeadlessContext headlessContext;
+	std::unique_ptr<OffscreenTarget> offscreen;
+	CameraPath cameraPath;
+	if (headless)
+	{
+		// the GPU driven path asks for 4.5 and falls back to the CPU path on 3.3
+		bool created = gpuCulling && headlessContext.create(4, 5);
+		if (!created)
+		{
+			headlessContext.destroy();
+			created = headlessContext.create(3, 3);
+		}
+		if (!created)
+			return -1;
+		framebufferWidth = headlessWidth;
+		framebufferHeight = headlessHeight;
+		offscreen.reset(new OffscreenTarget(headlessWidth, headlessHeight));
+		if (!cameraPathFile.empty())
+			cameraPath.load(cameraPathFile);
+	}
+	else
+	{
+		window = createWindow();
+		if (window == NULL)
+			return -1;
 	}
-	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
-
-	// tell GLFW to capture our mouse
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-	// glad: load all OpenGL function pointers
-	// ---------------------------------------
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	if (gpuCulling && !GpuCuller::isSupported())
 	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
-		return -1;
+		std::cout << "--gpu-culling ignored: it needs OpenGL 4.3 and the context is " << glExtensions().major << "."
+			<< glExtensions().minor << ", drawing on the CPU path instead" << std::endl;
+		gpuCulling = false;
 	}
 
 	// configure global opengl state
 	// -----------------------------
 	glEnable(GL_DEPTH_TEST);
 
-	// build and compile our shader zprogram
+
+	// build and compile our shader zprogram, or load it from the program binary cache
 	// ------------------------------------
-	Shader ourShader("shaderfiles/7.3.camera.vs", "shaderfiles/7.3.camera.fs");
-	Shader lightShader("shaderfiles/6.light_cube.vs", "shaderfiles/6.light_cube.fs");
+	Shader::cacheDirectory() = shaderCacheDir;
+	const char* litFragmentShader = pointLightCount > 0 ? "shaderfiles/7.6.clustered.fs" : "shaderfiles/7.4.camera_array.fs";
+	Shader ourShader(streamBuffers ? "shaderfiles/7.7.streamed.vs" : "shaderfiles/7.4.camera_array.vs", litFragmentShader);
+	Shader lightShader("shaderfiles/6.light_cube_ubo.vs", "shaderfiles/6.light_cube.fs");
+	Shader instancedShader("shaderfiles/7.4.camera_array_instanced.vs", litFragmentShader);
+
+	// view and projection live in one uniform buffer shared by every program
+	CameraUniforms camera;
+	camera.attach(ourShader.ID);
+	camera.attach(lightShader.ID);
+	camera.attach(instancedShader.ID);
+	std::unique_ptr<Shader> gpuDrivenShader;
+	if (gpuCulling)
+	{
+		gpuDrivenShader.reset(new Shader("shaderfiles/7.5.gpu_driven.vs", litFragmentShader));
+		camera.attach(gpuDrivenShader->ID);
+	}
+	const Shader::Stats& shaderStats = Shader::stats();
+	std::cout << "shaders: " << shaderStats.compiled << " compiled in " << shaderStats.compiledMs << " ms, "
+		<< shaderStats.cached << " from cache in " << shaderStats.cachedMs << " ms" << std::endl;
 
-	// set up vertex data (and buffer(s)) and configure vertex attributes
-	// ------------------------------------------------------------------
-	float vertices[] = {
-		-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-		 0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-		-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		-0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		-0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-		 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		 0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		 0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		 0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-		 0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-		 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-		 0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-		-0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-		-0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-		 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-		-0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-		-0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-	};
+	// one ring region per frame in flight for the lit program's Object records
+	std::unique_ptr<StreamBuffer> objectStream;
+	if (streamBuffers)
+	{
+		objectStream.reset(new StreamBuffer(GL_UNIFORM_BUFFER));
+		RenderQueue::attachObjectBlock(ourShader.ID);
+		std::cout << "object stream buffer: " << (objectStream->isPersistent() ? "persistent mapping" : "unsynchronized mapping") << std::endl;
+	}
+
+	// the frame's CPU work (light assignment, tree and LOD updates, draw recording) is
+	// split over a work-stealing pool; the main and render threads help while they wait
+	JobSystem jobs(jobThreads > 0 ? jobThreads - 1 : -1);
+	std::cout << "job system: " << jobs.workerCount() + 1 << " threads" << std::endl;
 
-	float planeVertices[] =
+	// point lights and their cluster grid, shared by the lit programs like the camera
+	std::unique_ptr<ClusteredLights> clusteredLights;
+	if (pointLightCount > 0)
 	{
-		//right triangle
-		-5.0f, -5.0f, -5.0f,  0.0f, 0.0f, 
-		 5.0f, -5.0f, -5.0f,  1.0f, 0.0f,
-		 5.0f, -5.0f,  5.0f,  1.0f, 1.0f,
-		 //left triangle
-		 5.0f, -5.0f,  5.0f,  1.0f, 1.0f,
-		-5.0f, -5.0f,  5.0f,  0.0f, 1.0f, 
-		-5.0f, -5.0f, -5.0f,  0.0f, 0.0f 
-	};
+		clusteredLights.reset(new ClusteredLights());
+		clusteredLights->setJobSystem(&jobs);
+		clusteredLights->attach(ourShader.ID);
+		clusteredLights->attach(instancedShader.ID);
+		if (gpuDrivenShader)
+			clusteredLights->attach(gpuDrivenShader->ID);
+	}
 
+	// set up vertex data (and buffer(s)) and configure vertex attributes
+	// ------------------------------------------------------------------
 	GLfloat treeVerts[] = {
 		// Vertex Positions    // Texture coords
 
@@ -194,447 +312,1010 @@ int main()
 		glm::vec3(0.0f,  0.0f, -3.0f)
 	};
 
-	unsigned int VBO, VAO;
-
-	//first cylinder
-	unsigned int VBO2, VAO2;
-
-	//second cylinder
-	unsigned int VBO3, VAO3;
-
-	//plane 
-	unsigned int VBO4, VAO4;
-
-	//tree leaves
-	unsigned int VBO5, VAO5;
-
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glBindVertexArray(VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-
-	// position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	// texture coord attribute
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-
-	//tree leaves
-	glGenVertexArrays(1, &VAO5);
-	glGenBuffers(1, &VBO5);
-	glBindVertexArray(VAO5);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO5);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(treeVerts), treeVerts, GL_STATIC_DRAW);
-
-	// position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	// texture coord attribute
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-
-	// second, configure the light's VAO (VBO stays the same; the vertices are the same for the light object which is also a 3D cube)
-	unsigned int lightCubeVAO;
-	glGenVertexArrays(1, &lightCubeVAO);
-	glBindVertexArray(lightCubeVAO);
-
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	// note that we update the lamp's position attribute's stride to reflect the updated buffer data
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-
-	// load textures (we now use a utility function to keep the code more organized)
-	// -----------------------------------------------------------------------------
-	unsigned int diffuseMap = loadTexture("container2.png");
-	unsigned int specularMap = loadTexture("container2.png");
-
-	glGenVertexArrays(1, &VAO2);
-	glGenBuffers(1, &VBO2);
-	glBindVertexArray(VAO2);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO2);
-
-	glGenVertexArrays(1, &VAO3);
-	glGenBuffers(1, &VBO3);
-	glBindVertexArray(VAO3);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO3);
-
-	
-	
-	////Plane//////
-	glGenVertexArrays(1, &VAO4);
-	glGenBuffers(1, &VBO4);
-	glBindVertexArray(VAO4);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO4);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
-
-	// position attribute
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
-	// texture coord attribute
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-	glEnableVertexAttribArray(1);
-
-	
-	
-	
-	
-	
-	// load and create a texture 
-	// -------------------------
-	unsigned int texture1, texture2, texture3, texture4, texture5, texture6;
-	// texture 1
-	// ---------
-	glGenTextures(1, &texture1);
-	glBindTexture(GL_TEXTURE_2D, texture1);
-	// set the texture wrapping parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// set texture filtering parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// load image, create texture and generate mipmaps
-	int width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-	unsigned char* data = stbi_load("wall.jpg", &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+	// the static scene (meshes, materials and object transforms) comes from a scene file,
+	// compiled to a binary that later runs map and upload without parsing
+	// -------------------------------------------------------------------------------------
+	float sceneLoadStart = getTime();
+	SceneFile scene;
+	if (!scene.open(sceneFile))
+	{
+		std::cout << "Failed to load scene: " << sceneFile << std::endl;
+		return -1;
 	}
-	else
+	scene.upload();
+	std::cout << "scene loaded in " << 1000.0f * (getTime() - sceneLoadStart) << " ms (" << scene.objectCount() << " objects)" << std::endl;
+
+	//trees: trunks and leaves are instanced, every copy is drawn by one call per mesh.
+	//trunks exist at every cylinder level of detail. both are welded into indexed meshes
+	//with their triangles ordered for the vertex cache
+	const int cylinderSlices[] = { 30, 16, 8, 5 };
+	const int cylinderLevels = sizeof(cylinderSlices) / sizeof(cylinderSlices[0]);
+	std::vector<std::unique_ptr<InstancedMesh> > trunkMeshes, forestTrunkMeshes;
+	std::vector<float> meshVertices;
+	std::vector<uint16_t> meshIndices;
+	mesh_builder::Report meshReport;
+	for (int i = 0; i < cylinderLevels; i++)
 	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data);
-	// texture 2
-	// ---------
-	glGenTextures(1, &texture2);
-	glBindTexture(GL_TEXTURE_2D, texture2);
-	// set the texture wrapping parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// set texture filtering parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// load image, create texture and generate mipmaps
-	data = stbi_load("grass.jpg", &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		// note that the awesomeface.png has transparency and thus an alpha channel, so make sure to tell OpenGL the data type is of GL_RGBA
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		std::vector<float> trunkVerts = primitives::cylinderVertices(1, cylinderSlices[i], 10);
+		mesh_builder::build(&trunkVerts[0], (int)trunkVerts.size() / primitives::FLOATS_PER_VERTEX, primitives::FLOATS_PER_VERTEX, meshVertices, meshIndices, &meshReport);
+		trunkMeshes.push_back(std::unique_ptr<InstancedMesh>(new InstancedMesh(meshVertices, meshIndices)));
+		if (forestTrees > 0)
+			forestTrunkMeshes.push_back(std::unique_ptr<InstancedMesh>(new InstancedMesh(meshVertices, meshIndices)));
+		std::cout << "trunk " << cylinderSlices[i] << " slices: " << meshReport.inputVertices << " -> " << meshReport.outputVertices << " vertices, ACMR "
+			<< meshReport.weldedACMR << " welded, " << meshReport.optimizedACMR << " optimized" << std::endl;
 	}
-	else
+	mesh_builder::build(treeVerts, sizeof(treeVerts) / (5 * sizeof(float)), 5, meshVertices, meshIndices, &meshReport);
+	InstancedMesh leafMesh(meshVertices, meshIndices);
+	std::unique_ptr<InstancedMesh> forestCanopyMesh;
+	if (forestTrees > 0)
+		forestCanopyMesh.reset(new InstancedMesh(meshVertices, meshIndices));
+	std::cout << "leaves: " << meshReport.inputVertices << " -> " << meshReport.outputVertices << " vertices, ACMR "
+		<< meshReport.weldedACMR << " welded, " << meshReport.optimizedACMR << " optimized" << std::endl;
+
+	// load textures: images are decoded in parallel on worker threads and uploaded on this
+	// thread as they finish, so the first frames may be drawn before every texture is ready.
+	// requests for the same file share a single decode and texture. each texture is also
+	// cached with its mip chain under texturecache/, later runs upload from that instead
+	// --------------------------------------------------------------------------------------
+	float textureLoadStart = getTime();
+	TextureLoader textureLoader(0, "texturecache");
+	unsigned int texture1 = textureLoader.load("wall.jpg");
+	unsigned int texture4 = textureLoader.load("bushes.png");
+	unsigned int texture5 = textureLoader.load("treetrunk.png");
+	bool texturesReady = false;
+
+	// the scene textures are resampled into the layers of one texture array as they
+	// arrive, so draws only select a layer and never rebind a texture. the array owns
+	// them from here on and deletes each 2D texture once it is copied, and the loader
+	// forgets the deleted name
+	// ------------------------------------------------------------------------------
+	TextureArray sceneTextures(1024, 1024, 3 + scene.materialCount());
+	const float layer1 = (float)sceneTextures.addLayer(texture1);
+	const float layer4 = (float)sceneTextures.addLayer(texture4);
+	const float layer5 = (float)sceneTextures.addLayer(texture5);
+	std::vector<float> materialLayers;
+	for (int i = 0; i < scene.materialCount(); i++)
+		materialLayers.push_back((float)sceneTextures.addLayer(textureLoader.load(scene.material(i).texture)));
+	textureLoader.setUploadCallback([&sceneTextures, &textureLoader](unsigned int texture)
+	{
+		if (sceneTextures.fill(texture))
+			textureLoader.release(texture);
+	});
+
+	// tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
+	// -------------------------------------------------------------------------------------------
+	ourShader.use();
+	ourShader.setInt("textures", 0);
+	instancedShader.use();
+	instancedShader.setInt("textures", 0);
+	if (gpuCulling)
 	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data);
-
-	// texture 3
-// ---------
-	glGenTextures(1, &texture3);
-	glBindTexture(GL_TEXTURE_2D, texture3);
-	// set the texture wrapping parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_LINEAR);
-	// set texture filtering parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// load image, create texture and generate mipmaps
-	width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-	unsigned char* data2 = stbi_load("concrete.png", &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data2);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		gpuDrivenShader->use();
+		gpuDrivenShader->setInt("textures", 0);
 	}
-	else
+
+	// per-draw uniforms are resolved once here and set through handles in the render loop
+	const Shader::Handle ourModel = ourShader.handle("model");
+	const Shader::Handle ourLayer = ourShader.handle("layer");
+	const Shader::Handle lightModel = lightShader.handle("model");
+
+	// build every distinct cylinder once; the render loop only draws the shared handles
+	// ---------------------------------------------------------------------------------
+	MeshCache meshCache;
+	std::vector<static_meshes_3D::Cylinder*> cylinderMeshes;
+	for (int i = 0; i < cylinderLevels; i++)
+		cylinderMeshes.push_back(meshCache.cylinder(3, cylinderSlices[i], 7, true, true, true));
+	std::cout << "Mesh cache: " << meshCache.size() << " distinct cylinder(s)" << std::endl;
+
+	// the trees as a transform hierarchy: one root per tree with the trunk and the canopy
+	// below it. the instance buffers are only refreshed when some root actually moved
+	// ------------------------------------------------------------------------
+	const glm::vec3 treePositions[] = {
+		glm::vec3(-11.0f, 0.0f, 0.0f),
+		glm::vec3(-15.0f, 0.0f, -2.0f),
+		glm::vec3(-7.0f, 0.0f, -1.0f)
+	};
+	const float trunkY[] = { 5.0f, 3.5f, 4.5f };
+	const float trunkHeight[] = { 1.0f, 0.7f, 0.9f };
+	const float leafHeight[] = { 8.0f, 6.5f, 7.5f };
+
+	TransformHierarchy treeTransforms;
+	std::vector<int> treeRoots, trunkNodes, leafNodes;
+	std::vector<glm::mat4> trunkInstances, leafInstances;
+	std::vector<float> trunkLayers, leafLayers;
+	for (int i = 0; i < 3; i++)
 	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data2);
-
-	// texture 4
-// ---------
-	glGenTextures(1, &texture4);
-	glBindTexture(GL_TEXTURE_2D, texture4);
-	// set the texture wrapping parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// set texture filtering parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// load image, create texture and generate mipmaps
-	width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-	unsigned char* data3 = stbi_load("bushes.png", &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data3);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		treeRoots.push_back(treeTransforms.add(glm::translate(glm::mat4(1.0f), treePositions[i])));
+		glm::mat4 trunk = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, trunkY[i], 0.0f));
+		trunkNodes.push_back(treeTransforms.add(glm::scale(trunk, glm::vec3(0.2f, trunkHeight[i], 0.2f)), treeRoots.back()));
+		trunkLayers.push_back(layer5);
+		glm::mat4 leaves = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 8.0f, 0.0f));
+		leafNodes.push_back(treeTransforms.add(glm::scale(leaves, glm::vec3(4.0f, leafHeight[i], 4.0f)), treeRoots.back()));
+		leafLayers.push_back(layer4);
 	}
-	else
+	treeTransforms.update();
+	for (size_t i = 0; i < treeRoots.size(); i++)
 	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-	stbi_image_free(data3);
-
-	// texture 5
-// ---------
-	glGenTextures(1, &texture5);
-	glBindTexture(GL_TEXTURE_2D, texture5);
-	// set the texture wrapping parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	// set texture filtering parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	// load image, create texture and generate mipmaps
-	width, height, nrChannels;
-	stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-	unsigned char* data4 = stbi_load("treetrunk.png", &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data4);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		trunkInstances.push_back(treeTransforms.getWorld(trunkNodes[i]));
+		leafInstances.push_back(treeTransforms.getWorld(leafNodes[i]));
 	}
-	else
+	leafMesh.setInstances(leafInstances, leafLayers);
+
+	// level of detail: a cylinder drops to the next coarser level once its bounding sphere
+	// is less than this many pixels tall on screen
+	const AABB trunkBounds(glm::vec3(-1.0f, -5.0f, -1.0f), glm::vec3(1.0f, 5.0f, 1.0f));
+	LodSelector cylinderLod({ 200.0f, 80.0f, 25.0f });
+	std::vector<InstancedMesh*> trunkLevels;
+	std::vector<AABB> trunkInstanceBounds;
+	for (int i = 0; i < cylinderLevels; i++)
+		trunkLevels.push_back(trunkMeshes[i].get());
+	for (size_t i = 0; i < trunkInstances.size(); i++)
+		trunkInstanceBounds.push_back(trunkBounds.transformed(trunkInstances[i]));
+	InstancedLod trunkLod(cylinderLod, trunkLevels);
+	trunkLod.setInstances(trunkInstances, trunkLayers, trunkInstanceBounds);
+
+	// the procedural forest, centered on the ground plane. it has instance buffers of its
+	// own, refilled from the visible grid cells whenever those change
+	Forest forest(trunkBounds, AABB(glm::vec3(-0.5f), glm::vec3(0.5f)));
+	std::vector<int> forestSteps;
+	if (forestBenchmark)
 	{
-		std::cout << "Failed to load texture" << std::endl;
+		for (int count = 1000; count < forestTrees; count *= 10)
+			forestSteps.push_back(count);
 	}
-	stbi_image_free(data4);
-	// tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-	// -------------------------------------------------------------------------------------------
-	ourShader.use();
-	ourShader.setInt("texture1", 0);
-	ourShader.setInt("texture2", 1);
-	ourShader.setInt("texture3", 2);
-	ourShader.setInt("texture4", 3);
-	ourShader.setInt("texture5", 4);
+	if (forestTrees > 0)
+		forestSteps.push_back(std::min(forestTrees, (int)Forest::MAX_TREES));
+	const glm::vec2 forestCenter(-4.0f, 5.0f);
+	auto generateForest = [&](int count)
+	{
+		const float side = forestArea > 0.0f ? forestArea : 5.0f * std::sqrt((float)count);
+		float start = getTime();
+		int placed = forest.generate(count, forestCenter - glm::vec2(0.5f * side), forestCenter + glm::vec2(0.5f * side), 1);
+		std::cout << "forest: " << placed << " trees on " << side << "x" << side << " in " << forest.getCellCount() << " cells, generated in "
+			<< 1000.0f * (getTime() - start) << " ms" << std::endl;
+	};
+	if (!forestSteps.empty())
+		generateForest(forestSteps[0]);
 
+	// programs and geometry known to the render queue
+	// ------------------------------------------------------------------------
+	RenderQueue renderQueue;
+	renderQueue.setStreamBuffer(objectStream.get());
+	const int litProgram = streamBuffers ? renderQueue.addStreamedProgram(&ourShader) : renderQueue.addProgram(&ourShader, ourModel, ourLayer);
+	const int instancedProgram = renderQueue.addProgram(&instancedShader);
+	const int lampProgram = renderQueue.addProgram(&lightShader, lightModel);
+	const int sceneGeometry = renderQueue.addIndexedArray(scene.VAO);
+	const int leafGeometry = renderQueue.addMesh(&leafMesh);
+	std::vector<int> cylinderGeometry, trunkGeometry;
+	for (int i = 0; i < cylinderLevels; i++)
+	{
+		cylinderGeometry.push_back(renderQueue.addMesh(cylinderMeshes[i]));
+		trunkGeometry.push_back(renderQueue.addMesh(trunkMeshes[i].get()));
+	}
+	std::vector<int> forestTrunkGeometry;
+	for (size_t i = 0; i < forestTrunkMeshes.size(); i++)
+		forestTrunkGeometry.push_back(renderQueue.addMesh(forestTrunkMeshes[i].get()));
+
+	// draws are timed on the GPU per group of scene objects when profiling
+	Profiler profiler;
+	if (profiling)
+	{
+		profiler.enable(traceFile);
+		renderQueue.setProfiler(&profiler);
+	}
+	const int cylindersGroup = profiler.addGpuGroup("cylinders");
+	const int treesGroup = profiler.addGpuGroup("trees");
+	const int forestGroup = profiler.addGpuGroup("forest");
+	const int gpuDrivenGroup = profiler.addGpuGroup("gpu-driven");
+	std::vector<int> sceneGroups;
+	for (int i = 0; i < scene.groupCount(); i++)
+		sceneGroups.push_back(profiler.addGpuGroup(scene.group(i)));
+
+	// geometry of every level, per level of detail group
+	std::vector<std::vector<int> > lodGroups;
+	lodGroups.push_back(cylinderGeometry);
+	const int cylinderLodGroup = 0;
+
+	// the static scene: none of these objects move, so their model matrices and world
+	// space bounds are computed once and a BVH over the bounds is used for culling
+	// ------------------------------------------------------------------------------
+	const AABB cubeBounds(glm::vec3(-0.5f), glm::vec3(0.5f));
+	const AABB cylinderBounds(glm::vec3(-3.0f, -3.5f, -3.0f), glm::vec3(3.0f, 3.5f, 3.0f));
+	std::vector<Renderable> sceneObjects;
 	glm::mat4 model;
-	float angle;
+
+	// boxes, pathway, bushes, plane and lamp come from the scene file. none of them move,
+	// so objects sharing a program are pre-transformed into one static batch that is drawn
+	// with a single call; their texture layers travel in the batch's vertices
+	StaticBatcher staticBatches;
+	GpuCuller gpuCuller;
+	for (int i = 0; i < scene.objectCount(); i++)
+	{
+		const scene_format::Object& object = scene.object(i);
+		const scene_format::Mesh& mesh = scene.mesh(object.mesh);
+		const AABB meshBounds(glm::make_vec3(mesh.boundsMin), glm::make_vec3(mesh.boundsMax));
+		int program = object.program == scene_format::PROGRAM_LAMP ? lampProgram : litProgram;
+		float layer = object.material < 0 ? 0.0f : materialLayers[object.material];
+		if (gpuCulling && program == litProgram)
+		{
+			gpuCuller.add(glm::make_mat4(object.model), meshBounds, layer, mesh.firstIndex, mesh.indexCount, mesh.baseVertex);
+			continue;
+		}
+		if (staticBatching)
+		{
+			staticBatches.add(program, layer, sceneGroups[object.group], scene.vertices() + mesh.baseVertex * scene_format::FLOATS_PER_VERTEX, mesh.vertexCount,
+				scene.indices() + mesh.firstIndex, mesh.indexCount, glm::make_mat4(object.model));
+			continue;
+		}
+		sceneObjects.push_back(Renderable(program, sceneGeometry, layer, glm::make_mat4(object.model), meshBounds, mesh.firstIndex, mesh.indexCount, mesh.baseVertex));
+		sceneObjects.back().profileGroup = sceneGroups[object.group];
+	}
+	staticBatches.update();
+	const int batchGeometry = renderQueue.addIndexedArray(staticBatches.VAO, GL_UNSIGNED_INT);
+	const size_t firstBatchObject = sceneObjects.size();
+	const std::vector<StaticBatcher::Batch>& batches = staticBatches.getBatches();
+	for (size_t i = 0; i < batches.size(); i++)
+	{
+		sceneObjects.push_back(Renderable(batches[i].program, batchGeometry, 0.0f, glm::mat4(1.0f), batches[i].bounds, batches[i].firstIndex, batches[i].indexCount));
+		sceneObjects.back().profileGroup = batches[i].profileGroup;
+	}
+	if (gpuCulling && !gpuCuller.create(scene.vertices(), scene.vertexCount(), scene.indices(), scene.indexCount(), "shaderfiles/gpu_cull.cs"))
+	{
+		std::cout << "Failed to set up GPU culling" << std::endl;
+		return -1;
+	}
+	if (gpuCulling)
+		std::cout << "GPU culling: " << gpuCuller.getObjectCount() << " objects in one indirect draw" << std::endl;
+	if (staticBatching)
+		std::cout << "static batching: " << staticBatches.getObjectCount() << " objects in " << batches.size() << " draws" << std::endl;
+
+	//first cylinder (left)
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.0f, 3.5f, 0.0f));
+	sceneObjects.push_back(Renderable(litProgram, cylinderGeometry[0], layer1, model, cylinderBounds));
+	sceneObjects.back().lodGroup = cylinderLodGroup;
+	sceneObjects.back().profileGroup = cylindersGroup;
+
+	//second cylinder (right)
+	model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(7.5f, 3.5f, 0.0f));
+	sceneObjects.push_back(Renderable(litProgram, cylinderGeometry[0], layer1, model, cylinderBounds));
+	sceneObjects.back().lodGroup = cylinderLodGroup;
+	sceneObjects.back().profileGroup = cylindersGroup;
+
+	//trees, one instanced draw per trunk level of detail and one for all leaves, bounded by the union of their instances
+	const size_t firstTreeObject = sceneObjects.size();
+	AABB trunkGroupBounds, leafGroupBounds;
+	for (size_t i = 0; i < trunkInstances.size(); i++)
+		trunkGroupBounds.expand(trunkBounds.transformed(trunkInstances[i]));
+	for (size_t i = 0; i < leafInstances.size(); i++)
+		leafGroupBounds.expand(cubeBounds.transformed(leafInstances[i]));
+	for (int i = 0; i < cylinderLevels; i++)
+	{
+		sceneObjects.push_back(Renderable(instancedProgram, trunkGeometry[i], 0.0f, glm::mat4(1.0f), trunkGroupBounds));
+		sceneObjects.back().profileGroup = treesGroup;
+	}
+	sceneObjects.push_back(Renderable(instancedProgram, leafGeometry, 0.0f, glm::mat4(1.0f), leafGroupBounds));
+	sceneObjects.back().profileGroup = treesGroup;
+
+	//the forest, one instanced draw per trunk level of detail and one for all canopies
+	const size_t firstForestObject = sceneObjects.size();
+	if (forestCanopyMesh)
+	{
+		for (size_t i = 0; i < forestTrunkMeshes.size(); i++)
+		{
+			sceneObjects.push_back(Renderable(instancedProgram, forestTrunkGeometry[i], 0.0f, glm::mat4(1.0f), forest.getBounds()));
+			sceneObjects.back().profileGroup = forestGroup;
+		}
+		sceneObjects.push_back(Renderable(instancedProgram, renderQueue.addMesh(forestCanopyMesh.get()), 0.0f, glm::mat4(1.0f), forest.getBounds()));
+		sceneObjects.back().profileGroup = forestGroup;
+	}
+
+	std::vector<AABB> sceneBounds;
+	for (size_t i = 0; i < sceneObjects.size(); i++)
+		sceneBounds.push_back(sceneObjects[i].bounds);
+	BVH sceneBVH;
+	sceneBVH.build(sceneBounds);
+	std::vector<int> visibleObjects;
+
+	// point lights: the four fixed positions first, the rest scattered over the scene
+	// with a fixed seed so runs stay comparable. every light circles its origin
+	std::vector<PointLight> pointLights;
+	std::vector<glm::vec3> lightOrigins;
+	std::vector<float> lightPhases;
+	if (clusteredLights)
+	{
+		AABB sceneExtent;
+		for (size_t i = 0; i < sceneBounds.size(); i++)
+			sceneExtent.expand(sceneBounds[i]);
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		for (int i = 0; i < pointLightCount; i++)
+		{
+			glm::vec3 origin = i < 4 ? pointLightPositions[i]
+				: sceneExtent.min + glm::vec3(unit(random), unit(random), unit(random)) * (sceneExtent.max - sceneExtent.min);
+			PointLight light;
+			light.position = origin;
+			light.radius = 2.0f + 4.0f * unit(random);
+			light.color = glm::vec3(0.3f) + 0.7f * glm::vec3(unit(random), unit(random), unit(random));
+			light.intensity = 1.5f;
+			pointLights.push_back(light);
+			lightOrigins.push_back(origin);
+			lightPhases.push_back(6.2831853f * unit(random));
+		}
+		std::cout << "clustered lighting: " << pointLightCount << " point lights in " << ClusteredLights::CLUSTERS_X << "x"
+			<< ClusteredLights::CLUSTERS_Y << "x" << ClusteredLights::CLUSTERS_Z << " clusters" << std::endl;
+	}
+	float lightTime = 0.0f;
+	float treeTime = 0.0f;
+
+	// a replay drives the camera from a recording and measures every frame; a recording
+	// stores the live camera of every frame for later replays
+	CameraRecording recording;
+	// a benchmark must not quietly measure a live session instead
+	if (!replayFile.empty() && !recording.load(replayFile))
+		return -1;
+	const bool replaying = !replayFile.empty();
+	const bool recordingFrames = !replaying && !recordFile.empty();
+	if (replayTimestep > 0.0f)
+		recording.setTimestep(replayTimestep);
+	// a windowed replay is a benchmark, the refresh rate must not cap it
+	if (replaying && window)
+		glfwSwapInterval(0);
+	FrameTimeStats replayStats;
+
+	// batch runs should not depend on how fast the textures happen to decode
+	if (headless || replaying)
+		textureLoader.finish();
+
+	// frames are captured at the size rendering starts with
+	std::unique_ptr<FrameCapture> capture;
+	if (headless && writeFrames && captureTarget.empty())
+		captureTarget = frameOutputDir;
+	if (!captureTarget.empty())
+	{
+		const bool video = captureTarget.size() > 4 && captureTarget.compare(captureTarget.size() - 4, 4, ".y4m") == 0;
+		if (!video)
+			ensureOutputDirectory(captureTarget);
+		capture.reset(new FrameCapture(framebufferWidth, framebufferHeight, video ? FrameCapture::Y4M : FrameCapture::PPM_SEQUENCE,
+			captureTarget, captureFps, 2, captureQueue));
+		if (!capture->isOpen())
+			capture.reset();
+	}
 
 	// render loop
 	// -----------
-	while (!glfwWindowShouldClose(window))
+	// a frame is split into two halves that only share a FrameSnapshot: simulate() samples
+	// input, moves the camera, animates the world and culls it, draw() makes every GL call.
+	// normally both run in turn on this thread. with --render-thread draw() runs on its
+	// own thread, which owns the GL context and always draws the newest snapshot, while
+	// this thread keeps polling input and simulating
+	const bool threaded = renderThread && !headless && !replaying;
+	if (renderThread && !threaded)
+		std::cout << "the render thread is only used for interactive runs" << std::endl;
+
+	int frameIndex = 0;
+	float runStart = getTime();
+	const int headlessLimit = forestBenchmark ? headlessFrames * (int)forestSteps.size() : headlessFrames;
+	const int frameLimit = replaying ? recording.frameCount() : (headless ? headlessLimit : -1);
+
+	// static batches are uploaded by draw(); the simulation owns the BVH and picks their
+	// new bounds up from here
+	std::mutex batchMutex;
+	bool batchesChanged = false;
+
+	// the window title may only be set from the thread that polls events
+	std::mutex titleMutex;
+	std::string pendingTitle;
+
+	int treeVersion = 0;
+
+	// forest cells drawn this frame, and the benchmark's frame times and drawn trees
+	std::vector<Forest::Visible> forestCells;
+	FrameTimeStats forestStats;
+	size_t forestDrawn = 0;
+	auto reportForestStep = [&]()
+	{
+		std::cout << "forest benchmark, " << forest.getTreeCount() << " trees (" << forestDrawn / std::max<size_t>(forestStats.size(), 1) << " drawn per frame), ";
+		forestStats.report(std::cout);
+		forestStats.clear();
+		forestDrawn = 0;
+	};
+
+	auto simulate = [&](FrameSnapshot& frame)
 	{
 		// per-frame time logic
 		// --------------------
-		float currentFrame = glfwGetTime();
+		float currentFrame = getTime();
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
 		// input
 		// -----
-		processInput(window);
+		if (!threaded)
+			profiler.beginCpu("input");
+		if (replaying)
+		{
+			// the previous frame's wall time; the first one also carries the setup
+			if (frameIndex > 0)
+				replayStats.add(deltaTime);
+			recording.apply(frameIndex, cameraPos, cameraFront, fov, isOrtho);
+			deltaTime = recording.getTimestep();
+		}
+		else if (!headless)
+			processInput(window);
+		else if (!cameraPath.isEmpty())
+			cameraPath.sample(frameIndex, cameraPos, cameraFront, fov);
+		if (recordingFrames)
+			recording.record(cameraPos, cameraFront, fov, isOrtho, deltaTime);
+
+		// world update
+		// ------------
+		if (!threaded)
+			profiler.beginCpu("update");
+
+		// the benchmark moves on to the next tree count every headlessFrames frames.
+		// deltaTime is the last frame's time; the first frame of a count is not measured,
+		// it generated the forest and uploaded its first instances
+		if (forestBenchmark && frameIndex > 0)
+		{
+			if (frameIndex % headlessFrames != 1)
+				forestStats.add(deltaTime);
+			if (frameIndex % headlessFrames == 0)
+			{
+				reportForestStep();
+				generateForest(forestSteps[frameIndex / headlessFrames]);
+				for (size_t i = firstForestObject; i < sceneObjects.size(); i++)
+					sceneObjects[i].bounds = sceneBounds[i] = forest.getBounds();
+				sceneBVH.build(sceneBounds);
+			}
+		}
+
+		// edited static objects only rebuilt their own batch
+		{
+			std::lock_guard<std::mutex> lock(batchMutex);
+			if (batchesChanged)
+			{
+				for (size_t i = 0; i < batches.size(); i++)
+				{
+					Renderable& batch = sceneObjects[firstBatchObject + i];
+					batch.first = batches[i].firstIndex;
+					batch.count = batches[i].indexCount;
+					batch.bounds = sceneBounds[firstBatchObject + i] = batches[i].bounds;
+				}
+				sceneBVH.build(sceneBounds);
+				batchesChanged = false;
+			}
+		}
+
+		// swaying trees only set their roots; the hierarchy recomputes the subtrees below
+		// them and nothing is re-uploaded for trees that did not move
+		if (swayingTrees)
+		{
+			treeTime += deltaTime;
+			for (size_t i = 0; i < treeRoots.size(); i++)
+			{
+				glm::mat4 root = glm::translate(glm::mat4(1.0f), treePositions[i]);
+				treeTransforms.setLocal(treeRoots[i], glm::rotate(root, 0.05f * std::sin(1.3f * treeTime + (float)i), glm::vec3(0.0f, 0.0f, 1.0f)));
+			}
+		}
+		if (!treeTransforms.update().empty())
+		{
+			// each thread bounds the trees it moved, the group bounds are their union
+			std::vector<AABB> trunkSlotBounds(jobs.slotCount()), leafSlotBounds(jobs.slotCount());
+			jobs.parallelFor(0, treeRoots.size(), 64, [&](size_t first, size_t last)
+			{
+				const int slot = jobs.slot();
+				for (size_t i = first; i < last; i++)
+				{
+					trunkInstances[i] = treeTransforms.getWorld(trunkNodes[i]);
+					leafInstances[i] = treeTransforms.getWorld(leafNodes[i]);
+					trunkInstanceBounds[i] = trunkBounds.transformed(trunkInstances[i]);
+					trunkSlotBounds[slot].expand(trunkInstanceBounds[i]);
+					leafSlotBounds[slot].expand(cubeBounds.transformed(leafInstances[i]));
+				}
+			});
+			trunkGroupBounds = AABB();
+			leafGroupBounds = AABB();
+			for (int i = 0; i < jobs.slotCount(); i++)
+			{
+				trunkGroupBounds.expand(trunkSlotBounds[i]);
+				leafGroupBounds.expand(leafSlotBounds[i]);
+			}
+			for (int i = 0; i < cylinderLevels; i++)
+				sceneObjects[firstTreeObject + i].bounds = sceneBounds[firstTreeObject + i] = trunkGroupBounds;
+			sceneObjects[firstTreeObject + cylinderLevels].bounds = sceneBounds[firstTreeObject + cylinderLevels] = leafGroupBounds;
+			sceneBVH.build(sceneBounds);
+			treeVersion++;
+		}
+
+		// cull the scene against the view frustum; draw() queues whatever is left
+		visibleObjects.clear();
+		if (framebufferWidth > 0 && framebufferHeight > 0)
+		{
+			const glm::mat4 projection = CameraUniforms::buildProjection(fov, isOrtho, framebufferWidth, framebufferHeight);
+			const glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+			const Frustum frustum(projection * view);
+			sceneBVH.cull(frustum, sceneBounds, visibleObjects);
+
+			// forest cells are culled as a grid, with a level of detail per cell
+			if (forest.getTreeCount() > 0)
+			{
+				forest.update(frustum, cameraPos, forestDistance, cylinderLod, projection, framebufferHeight, forestCells);
+				forestDrawn += forest.countTrees(forestCells);
+			}
+
+			// level of detail: visible cylinders switch to fewer slices as they shrink on screen
+			jobs.parallelFor(0, visibleObjects.size(), 256, [&](size_t first, size_t last)
+			{
+				for (size_t i = first; i < last; i++)
+				{
+					Renderable& object = sceneObjects[visibleObjects[i]];
+					if (object.lodGroup < 0)
+						continue;
+					float size = projectedSize(object.bounds, cameraPos, projection, framebufferHeight);
+					object.lodLevel = cylinderLod.select(object.lodLevel, size);
+					object.geometry = lodGroups[object.lodGroup][object.lodLevel];
+				}
+			});
+		}
+
+		// move the point lights
+		lightTime += deltaTime;
+		jobs.parallelFor(0, lightOrigins.size(), 1024, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+			{
+				float angle = 0.5f * lightTime + lightPhases[i];
+				pointLights[i].position = lightOrigins[i] + glm::vec3(std::cos(angle), 0.25f * std::sin(2.0f * angle), std::sin(angle));
+			}
+		});
+
+		// hand the frame over
+		frame.frameIndex = frameIndex++;
+		frame.time = currentFrame;
+		frame.cameraPos = cameraPos;
+		frame.cameraFront = cameraFront;
+		frame.cameraUp = cameraUp;
+		frame.fov = fov;
+		frame.isOrtho = isOrtho;
+		frame.width = framebufferWidth;
+		frame.height = framebufferHeight;
+		frame.visible.clear();
+		for (size_t i = 0; i < visibleObjects.size(); i++)
+			frame.visible.push_back(sceneObjects[visibleObjects[i]]);
+		frame.lights = pointLights;
+		frame.treeVersion = treeVersion;
+		frame.trunkInstances = trunkInstances;
+		frame.leafInstances = leafInstances;
+		frame.trunkBounds = trunkInstanceBounds;
+		frame.forestVersion = forest.getVersion();
+		frame.forestCells = forestCells;
+	};
+
+	// draws are recorded into one command list per job slot and concatenated afterwards
+	std::vector<RenderQueue::CommandList> commandLists(jobs.slotCount());
+	int drawnTreeVersion = 0;
+	int drawnForestVersion = 0;
+	std::vector<Forest::Visible> drawnForestCells;
+	std::vector<std::vector<glm::mat4> > forestTrunks;
+	std::vector<glm::mat4> forestCanopies;
+	std::vector<float> forestLayers;
+	int viewportWidth = 0, viewportHeight = 0;
+	float lastDraw = runStart;
+	auto draw = [&](const FrameSnapshot& frame)
+	{
+		// frame time statistics, measured between draws
+		// ---------------------------------------------
+		float drawStart = getTime();
+		frameTimeTotal += drawStart - lastDraw;
+		frameTimeSamples++;
+		lastDraw = drawStart;
+		if (drawStart - frameTimeReportStart >= 5.0f)
+		{
+			const RenderQueue::Stats& queueStats = renderQueue.getStats();
+			std::cout << "avg frame time: " << 1000.0f * frameTimeTotal / frameTimeSamples << " ms over " << frameTimeSamples << " frames, "
+				<< queueStats.commands << " draws, " << queueStats.programChanges + queueStats.layerChanges + queueStats.geometryChanges + queueStats.objectBinds + queueStats.recordChanges << " state changes, "
+				<< queueStats.avoided << " avoided, " << frame.visible.size() << "/" << sceneObjects.size() << " objects visible" << std::endl;
+			frameTimeTotal = 0.0f;
+			frameTimeSamples = 0;
+			frameTimeReportStart = drawStart;
+		}
+
+		// profiler overlay: per frame averages in the window title, on stdout when headless
+		if (profiling && drawStart - profileReportStart >= (headless ? 5.0f : 0.5f))
+		{
+			if (headless)
+				std::cout << profiler.summary() << std::endl;
+			else if (threaded)
+			{
+				std::lock_guard<std::mutex> lock(titleMutex);
+				pendingTitle = "LearnOpenGL | " + profiler.summary();
+			}
+			else
+				glfwSetWindowTitle(window, ("LearnOpenGL | " + profiler.summary()).c_str());
+			profileReportStart = drawStart;
+		}
+
+		// upload whatever textures finished decoding since the last frame
+		profiler.beginCpu("textures");
+		if (!texturesReady)
+		{
+			textureLoader.pump();
+			if (textureLoader.done())
+			{
+				texturesReady = true;
+				textureLoader.deleteBuffers();
+				std::cout << "textures ready after " << 1000.0f * (drawStart - textureLoadStart) << " ms (" << textureLoader.getCacheHits() << " from cache)" << std::endl;
+			}
+		}
+
+		// regenerate the array's mipmaps if layers arrived, and keep it bound to unit 0
+		sceneTextures.update(0);
 
 		// render
 		// ------
+		profiler.beginCpu("upload");
+		if (frame.width != viewportWidth || frame.height != viewportHeight)
+		{
+			glViewport(0, 0, frame.width, frame.height);
+			viewportWidth = frame.width;
+			viewportHeight = frame.height;
+		}
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// world transformation
-		glm::mat4 model = glm::mat4(1.0f);
-		lightShader.setMat4("model", model);
+		// projection and camera/view transformation, only recomputed and uploaded when
+		// the camera, field of view, ortho switch or window size actually changed
+		camera.setProjection(frame.fov, frame.isOrtho, frame.width, frame.height);
+		camera.setView(frame.cameraPos, frame.cameraFront, frame.cameraUp);
+		camera.update();
 
+		// re-upload edited static batches and moved trees
+		{
+			std::lock_guard<std::mutex> lock(batchMutex);
+			if (staticBatches.update())
+				batchesChanged = true;
+		}
+		if (frame.treeVersion != drawnTreeVersion)
+		{
+			leafMesh.setInstances(frame.leafInstances, leafLayers);
+			trunkLod.setTransforms(frame.trunkInstances, frame.trunkBounds);
+			drawnTreeVersion = frame.treeVersion;
+		}
+		trunkLod.update(frame.cameraPos, camera.getProjection(), frame.height);
 
-		// activate shader
-		ourShader.use();
+		// the forest's instances are gathered from the visible cells when those changed
+		if (forestCanopyMesh && (frame.forestVersion != drawnForestVersion || frame.forestCells != drawnForestCells))
+		{
+			forest.gather(frame.forestCells, (int)forestTrunkMeshes.size(), forestTrunks, forestCanopies, jobs);
+			for (size_t i = 0; i < forestTrunkMeshes.size(); i++)
+			{
+				forestLayers.assign(forestTrunks[i].size(), layer5);
+				forestTrunkMeshes[i]->setInstances(forestTrunks[i], forestLayers);
+			}
+			forestLayers.assign(forestCanopies.size(), layer4);
+			forestCanopyMesh->setInstances(forestCanopies, forestLayers);
+			drawnForestVersion = frame.forestVersion;
+			drawnForestCells = frame.forestCells;
+		}
+
+		// assign the point lights to the clusters of this view
+		if (clusteredLights)
+		{
+			profiler.beginCpu("lights");
+			clusteredLights->lights = frame.lights;
+			clusteredLights->update(camera.getView(), camera.getProjection(), frame.width, frame.height);
+			clusteredLights->bind();
+		}
+
+		// the queue sorts the visible draws by program, texture layer, geometry and depth
+		// and then issues them with redundant state changes filtered out
+		profiler.beginCpu("submit");
+		for (size_t i = 0; i < commandLists.size(); i++)
+			commandLists[i].begin(frame.cameraPos);
+		jobs.parallelFor(0, frame.visible.size(), 256, [&](size_t first, size_t last)
+		{
+			RenderQueue::CommandList& list = commandLists[jobs.slot()];
+			for (size_t i = first; i < last; i++)
+				list.submit(frame.visible[i]);
+		});
+		renderQueue.begin(frame.cameraPos);
+		for (size_t i = 0; i < commandLists.size(); i++)
+			renderQueue.append(commandLists[i]);
+		renderQueue.sort();
+		renderQueue.execute();
+
+		// the GPU driven objects: culled by a compute shader and drawn by one multi-draw
+		if (gpuCulling)
+		{
+			profiler.beginGpu(gpuDrivenGroup);
+			gpuCuller.cull(Frustum(camera.getViewProjection()));
+			gpuDrivenShader->use();
+			gpuCuller.render();
+			profiler.endGpu();
+		}
 
-		
-		glm::mat4 projection;
-		if (isOrtho) 
+		profiler.beginCpu("swap");
+		// start reading the frame back; it is mapped and handed to the encoders a few
+		// frames later
+		if (capture)
+			capture->capture(headless ? offscreen->FBO : 0, frame.width, frame.height, frame.frameIndex);
+		if (headless)
 		{
-			float scale = 20;
-			projection = glm::ortho(-(800.0f / scale), 800.0f / scale, 600.0f / scale, -(600.0f / scale), 5.0f, -5.0f);
+			// the benchmark times whole frames, GPU work included
+			if (forestBenchmark)
+				glFinish();
 		}
 		else
+		{
+			// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.);
+			// the render thread leaves the polling to the simulation
+			// -------------------------------------------------------------------------------
+			glfwSwapBuffers(window);
+			if (!threaded)
+				glfwPollEvents();
+		}
+	};
+
+	if (threaded)
+	{
+		// the render thread holds the GL context until the window closes
+		SnapshotMailbox<FrameSnapshot> mailbox;
+		glfwMakeContextCurrent(NULL);
+		std::thread renderer([&]()
+		{
+			glfwMakeContextCurrent(window);
+			while (const FrameSnapshot* frame = mailbox.acquire())
+			{
+				profiler.beginFrame();
+				draw(*frame);
+				profiler.endFrame();
+			}
+			glFinish();
+			glfwMakeContextCurrent(NULL);
+		});
+
+		// simulate at a fixed rate and wait for input events in between
+		float nextStep = getTime();
+		while (!glfwWindowShouldClose(window))
+		{
+			float now = getTime();
+			if (now < nextStep)
+			{
+				glfwWaitEventsTimeout(nextStep - now);
+				continue;
+			}
+			nextStep = now + SIMULATION_STEP;
+			glfwPollEvents();
+			simulate(mailbox.back());
+			mailbox.publish();
+
+			std::string title;
 			{
-			// pass projection matrix to shader (note that in this case it could change every frame)
-			projection = glm::perspective(glm::radians(fov), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+				std::lock_guard<std::mutex> lock(titleMutex);
+				title.swap(pendingTitle);
 			}
+			if (!title.empty())
+				glfwSetWindowTitle(window, title.c_str());
+		}
+		mailbox.close();
+		renderer.join();
+		glfwMakeContextCurrent(window);
+	}
+	else
+	{
+		FrameSnapshot frame;
+		while ((frameLimit < 0 || frameIndex < frameLimit) && (headless || !glfwWindowShouldClose(window)))
+		{
+			profiler.beginFrame();
+			simulate(frame);
+			draw(frame);
+			profiler.endFrame();
+		}
+	}
+
+	if (replaying)
+	{
+		glFinish();
+		if (frameIndex > 0)
+			replayStats.add(getTime() - lastFrame);
+		std::cout << "replay of " << replayFile << ", ";
+		replayStats.report(std::cout);
+	}
+	if (forestBenchmark)
+	{
+		if (frameIndex > 1)
+			forestStats.add(getTime() - lastFrame);
+		reportForestStep();
+	}
+	if (recordingFrames && recording.save(recordFile))
+		std::cout << "recorded " << recording.frameCount() << " frames to " << recordFile << std::endl;
 
-		ourShader.setMat4("projection", projection);
-
-
-		// camera/view transformation
-		glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
-		ourShader.setMat4("view", view);
-
-		// render boxes
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture1);
-		glBindVertexArray(VAO);
-		// calculate the model matrix for each object and pass it to shader before drawing
-		model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first		
-		model = glm::translate(model, glm::vec3(3.75f, 5.0f, 0.0f));
-		model = glm::scale(model, glm::vec3(2.0f, 4.0f, 1.0f));
-		angle = 0.0f;
-		model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-		ourShader.setMat4("model", model);
-
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-		//first cylinder (left)
-	
-		glBindVertexArray(VAO2);
-		model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first		
-		model = glm::translate(model, glm::vec3(0.0f, 3.5f, 0.0f));
-		ourShader.setMat4("model", model);
-
-		static_meshes_3D::Cylinder C(3, 30, 7, true, true, true);
-		C.render();
-
-		//second cylinder (right)
-		
-		glBindVertexArray(VAO3);
-		model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first		
-		model = glm::translate(model, glm::vec3(7.5f, 3.5f, 0.0f));
-		ourShader.setMat4("model", model);
-
-		static_meshes_3D::Cylinder C2(3, 30, 7, true, true, true);
-		C2.render();
-
-		//trees
-		//first tree
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture5);
-		glBindVertexArray(VAO2);
-		model = glm::mat4(1.0f); 	
-		model = glm::translate(model, glm::vec3(-11.0f, 5.0f, 0.0f));
-		model = glm::scale(model, glm::vec3(0.2f, 1.0f, 0.2f));
-		ourShader.setMat4("model", model);
-		static_meshes_3D::Cylinder tree1(1, 30, 10, true, true, true);
-		tree1.render();
-		//leaves
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture4);
-		glBindVertexArray(VAO5);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(-11.0f, 8.0f, 0.0f));
-		model = glm::scale(model, glm::vec3(4.0f, 8.0f, 4.0f));
-		ourShader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, 18);
-
-		//second tree
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture5);
-		glBindVertexArray(VAO2);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(-15.0f, 3.5f, -2.0f));
-		model = glm::scale(model, glm::vec3(0.2f, 0.7f, 0.2f));
-		ourShader.setMat4("model", model);
-		static_meshes_3D::Cylinder tree2(1, 30, 10, true, true, true);
-		tree2.render();
-		//leaves
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture4);
-		glBindVertexArray(VAO5);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(-15.0f, 8.0f, -2.0f));
-		model = glm::scale(model, glm::vec3(4.0f, 6.5f, 4.0f));
-		ourShader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, 18);
-
-		//third tree
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture5);
-		glBindVertexArray(VAO2);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(-7.0f, 4.5f, -1.0f));
-		model = glm::scale(model, glm::vec3(0.2f, 0.9f, 0.2f));
-		ourShader.setMat4("model", model);
-		static_meshes_3D::Cylinder tree3(1, 30, 10, true, true, true);
-		tree3.render();
-		//leaves
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture4);
-		glBindVertexArray(VAO5);
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(-7.0f, 8.0f, -1.0f));
-		model = glm::scale(model, glm::vec3(4.0f, 7.5f, 4.0f));
-		ourShader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, 18);
-
-		//pathway
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture3);
-		glBindVertexArray(VAO4);
-		model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first		
-		model = glm::translate(model, glm::vec3(3.75f, 5.01f, 5.0f));
-		model = glm::scale(model, glm::vec3(0.2f, 1.0f, 3.0f));
-		ourShader.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		//bushes
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture4);
-		glBindVertexArray(VAO);
-		model = glm::mat4(1.0f);	
-		model = glm::translate(model, glm::vec3(0.75f, 1.0f, 11.0f));
-		model = glm::scale(model, glm::vec3(4.0f, 2.0f, 18.0f));
-		angle = 0.0f;
-		model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-		ourShader.setMat4("model", model);
-
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-
-
-		//render plane
-		
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture2);
-		glBindVertexArray(VAO4);
-		// calculate the model matrix for each object and pass it to shader before drawing
-		model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first		
-		model = glm::translate(model, glm::vec3(-4.0f, 5.0f, 5.0f));
-		model = glm::scale(model, glm::vec3(3.0f, 1.0f, 3.0f));
-		//angle = 0.0f;
-		//model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-		ourShader.setMat4("model", model);
-
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-
-		// also draw the lamp object(s)
-		lightShader.use();
-		lightShader.setMat4("projection", projection);
-		lightShader.setMat4("view", view);
-
-		// we now draw as many light bulbs as we have point lights.
-		glBindVertexArray(VAO);
-			
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, glm::vec3(0.0f, 15.0f, -30.0f));
-			model = glm::scale(model, glm::vec3(3.0f)); // Make it a smaller cube
-			lightShader.setMat4("model", model);
-			glDrawArrays(GL_TRIANGLES, 0, 36);
-		
-
-
-		// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-		// -------------------------------------------------------------------------------
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+	if (capture)
+	{
+		// the headless frame rate below includes waiting for the last frames to be written
+		capture->finish();
+		const FrameCapture::Stats& captureStats = capture->getStats();
+		std::cout << "captured " << captureStats.written << " frames to " << capture->getPath();
+		if (captureStats.failed > 0)
+			std::cout << " (" << captureStats.failed << " failed)";
+		std::cout << ", waited for the encoders " << captureStats.stalls << " times for " << captureStats.stallMs << " ms" << std::endl;
+		capture->deleteBuffers();
+	}
+
+	if (headless)
+	{
+		glFinish();
+		float runTime = getTime() - runStart;
+		std::cout << "rendered " << frameIndex << " frames at " << headlessWidth << "x" << headlessHeight << " in " << runTime << " s ("
+			<< frameIndex / runTime << " fps)" << std::endl;
+		offscreen->deleteBuffers();
 	}
 
 	// optional: de-allocate all resources once they've outlived their purpose:
 	// ------------------------------------------------------------------------
-	glDeleteVertexArrays(1, &VAO);
-	glDeleteBuffers(1, &VBO);
-
-	glDeleteVertexArrays(1, &VAO2);
-	glDeleteBuffers(1, &VBO2);
+	scene.deleteBuffers();
+	staticBatches.deleteBuffers();
+	gpuCuller.deleteBuffers();
+	if (clusteredLights)
+		clusteredLights->deleteBuffers();
+	if (objectStream)
+		objectStream->deleteBuffers();
+
+	meshCache.clear();
+	for (int i = 0; i < cylinderLevels; i++)
+		trunkMeshes[i]->deleteMesh();
+	leafMesh.deleteMesh();
+	for (size_t i = 0; i < forestTrunkMeshes.size(); i++)
+		forestTrunkMeshes[i]->deleteMesh();
+	if (forestCanopyMesh)
+		forestCanopyMesh->deleteMesh();
+	sceneTextures.deleteArray();
+	camera.deleteBuffer();
+	profiler.deleteQueries();
+	profiler.closeTrace();
 
 	// glfw: terminate, clearing all previously allocated GLFW resources.
 	// ------------------------------------------------------------------
-	glfwTerminate();
+	if (!headless)
+		glfwTerminate();
 	return 0;
 }
 
+// glfw: initialize, create the window and load the OpenGL function pointers for it
+// ---------------------------------------------------------------------------------
+GLFWwindow* createWindow()
+{
+	glfwInit();
+	// the GPU driven path asks for 4.5 and falls back to the CPU path on 3.3
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, gpuCulling ? 4 : 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, gpuCulling ? 5 : 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+	// glfw window creation
+	// --------------------
+	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+	if (window == NULL && gpuCulling)
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+	}
+	if (window == NULL)
+	{
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return NULL;
+	}
+	glfwMakeContextCurrent(window);
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	glfwSetCursorPosCallback(window, mouse_callback);
+	glfwSetScrollCallback(window, scroll_callback);
+
+	// tell GLFW to capture our mouse
+	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+	// glad: load all OpenGL function pointers
+	// ---------------------------------------
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	{
+		std::cout << "Failed to initialize GLAD" << std::endl;
+		return NULL;
+	}
+	// and the entry points beyond 3.3 that optional paths use
+	loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+
+	return window;
+}
+
+// command line options
+// --------------------
+void parseArguments(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--headless")
+			headless = true;
+		else if (arg == "--size" && hasValue)
+			sscanf(argv[++i], "%dx%d", &headlessWidth, &headlessHeight);
+		else if (arg == "--frames" && hasValue)
+			headlessFrames = atoi(argv[++i]);
+		else if (arg == "--camera-path" && hasValue)
+			cameraPathFile = argv[++i];
+		else if (arg == "--output" && hasValue)
+			frameOutputDir = argv[++i];
+		else if (arg == "--no-output")
+			writeFrames = false;
+		else if (arg == "--capture" && hasValue)
+			captureTarget = argv[++i];
+		else if (arg == "--capture-fps" && hasValue)
+			captureFps = std::max(atoi(argv[++i]), 1);
+		else if (arg == "--capture-queue" && hasValue)
+			captureQueue = std::max(atoi(argv[++i]), 1);
+		else if (arg == "--record" && hasValue)
+			recordFile = argv[++i];
+		else if (arg == "--replay" && hasValue)
+			replayFile = argv[++i];
+		else if (arg == "--timestep" && hasValue)
+			replayTimestep = (float)atof(argv[++i]);
+		else if (arg == "--scene" && hasValue)
+			sceneFile = argv[++i];
+		else if (arg == "--compile-scene")
+			compileSceneOnly = true;
+		else if (arg == "--no-batching")
+			staticBatching = false;
+		else if (arg == "--gpu-culling")
+			gpuCulling = true;
+		else if (arg == "--lights" && hasValue)
+			pointLightCount = std::min(std::max(atoi(argv[++i]), 0), (int)ClusteredLights::MAX_LIGHTS);
+		else if (arg == "--forest" && hasValue)
+			forestTrees = std::min(std::max(atoi(argv[++i]), 0), (int)Forest::MAX_TREES);
+		else if (arg == "--forest-area" && hasValue)
+			forestArea = (float)atof(argv[++i]);
+		else if (arg == "--forest-distance" && hasValue)
+			forestDistance = (float)atof(argv[++i]);
+		else if (arg == "--forest-benchmark")
+			forestBenchmark = true;
+		else if (arg == "--sway-trees")
+			swayingTrees = true;
+		else if (arg == "--jobs" && hasValue)
+			jobThreads = std::max(atoi(argv[++i]), 0);
+		else if (arg == "--no-stream-buffer")
+			streamBuffers = false;
+		else if (arg == "--render-thread")
+			renderThread = true;
+		else if (arg == "--shader-cache" && hasValue)
+			shaderCacheDir = argv[++i];
+		else if (arg == "--no-shader-cache")
+			shaderCacheDir.clear();
+		else if (arg == "--profile")
+			profiling = true;
+		else if (arg == "--trace" && hasValue)
+		{
+			profiling = true;
+			traceFile = argv[++i];
+		}
+		else
+			std::cout << "Unknown argument: " << arg << std::endl;
+	}
+}
+
+// seconds since the first call; works without GLFW, which headless runs do not initialize
+// -----------------------------------------------------------------------------------------
+float getTime()
+{
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	return std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 // ---------------------------------------------------------------------------------------------------------
 void processInput(GLFWwindow* window)
@@ -688,9 +1369,10 @@ void processInput(GLFWwindow* window)
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	// make sure the viewport matches the new window dimensions; note that width and 
-	// height will be significantly larger than specified on retina displays.
-	glViewport(0, 0, width, height);
+	// the viewport follows in draw(), which may run on the render thread; note that width
+	// and height will be significantly larger than specified on retina displays.
+	framebufferWidth = width;
+	framebufferHeight = height;
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -752,42 +1434,3 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 		}
 	}
 }
-
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const* path)
-{
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
-}
\ No newline at end of file
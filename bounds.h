@@ -0,0 +1,117 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// axis aligned bounding box
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	AABB()
+		: min(1e30f), max(-1e30f)
+	{
+	}
+
+	AABB(const glm::vec3& min, const glm::vec3& max)
+		: min(min), max(max)
+	{
+	}
+
+	glm::vec3 center() const
+	{
+		return (min + max) * 0.5f;
+	}
+
+	glm::vec3 extents() const
+	{
+		return (max - min) * 0.5f;
+	}
+
+	bool isEmpty() const
+	{
+		return min.x > max.x || min.y > max.y || min.z > max.z;
+	}
+
+	void expand(const AABB& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	// bounds of this box after transforming it by m (Arvo's method)
+	// ------------------------------------------------------------------------
+	AABB transformed(const glm::mat4& m) const
+	{
+		glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+		glm::vec3 e = extents();
+		glm::vec3 r;
+		for (int i = 0; i < 3; i++)
+			r[i] = std::fabs(m[0][i]) * e.x + std::fabs(m[1][i]) * e.y + std::fabs(m[2][i]) * e.z;
+		return AABB(c - r, c + r);
+	}
+};
+
+// the six planes of a view frustum, extracted from a projection * view matrix
+// (Gribb/Hartmann), normals pointing inwards
+struct Frustum
+{
+	enum Result
+	{
+		OUTSIDE,
+		INTERSECTS,
+		INSIDE
+	};
+
+	glm::vec4 planes[6];
+
+	Frustum()
+	{
+	}
+
+	explicit Frustum(const glm::mat4& viewProjection)
+	{
+		// glm is column major, so row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+		planes[0] = rows[3] + rows[0];	// left
+		planes[1] = rows[3] - rows[0];	// right
+		planes[2] = rows[3] + rows[1];	// bottom
+		planes[3] = rows[3] - rows[1];	// top
+		planes[4] = rows[3] + rows[2];	// near
+		planes[5] = rows[3] - rows[2];	// far
+		for (int i = 0; i < 6; i++)
+		{
+			float length = glm::length(glm::vec3(planes[i]));
+			if (length > 0.0f)
+				planes[i] = planes[i] / length;
+		}
+	}
+
+	// classifies a box against the frustum
+	// ------------------------------------------------------------------------
+	Result test(const AABB& box) const
+	{
+		glm::vec3 c = box.center();
+		glm::vec3 e = box.extents();
+		Result result = INSIDE;
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 n(planes[i]);
+			float d = glm::dot(n, c) + planes[i].w;
+			float r = glm::dot(glm::abs(n), e);
+			if (d + r < 0.0f)
+				return OUTSIDE;
+			if (d - r < 0.0f)
+				result = INTERSECTS;
+		}
+		return result;
+	}
+};
+
+#endif
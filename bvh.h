@@ -0,0 +1,116 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "bounds.h"
+
+#include <algorithm>
+#include <vector>
+
+// bounding volume hierarchy over a fixed set of boxes, built by splitting at the median
+// of the longest axis. every node covers a contiguous range of the reordered item list,
+// so a node that lies completely inside the frustum adds its items without testing them
+class BVH
+{
+public:
+	static const int LEAF_SIZE = 4;
+
+	// (re)builds the tree; items are referred to by their index in bounds
+	// ------------------------------------------------------------------------
+	void build(const std::vector<AABB>& bounds)
+	{
+		nodes.clear();
+		items.resize(bounds.size());
+		for (size_t i = 0; i < items.size(); i++)
+			items[i] = (int)i;
+		if (items.empty())
+			return;
+		nodes.push_back(Node());
+		buildNode(bounds, 0, 0, (int)items.size());
+	}
+
+	// appends the index of every item whose box is not completely outside the frustum
+	// ------------------------------------------------------------------------
+	void cull(const Frustum& frustum, const std::vector<AABB>& bounds, std::vector<int>& visible) const
+	{
+		if (nodes.empty())
+			return;
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			Frustum::Result result = frustum.test(node.bounds);
+			if (result == Frustum::OUTSIDE)
+				continue;
+			if (result == Frustum::INSIDE)
+			{
+				visible.insert(visible.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+			}
+			else if (node.left < 0)
+			{
+				for (int i = node.first; i < node.first + node.count; i++)
+				{
+					if (frustum.test(bounds[items[i]]) != Frustum::OUTSIDE)
+						visible.push_back(items[i]);
+				}
+			}
+			else
+			{
+				stack[top++] = node.left;
+				stack[top++] = node.left + 1;
+			}
+		}
+	}
+
+	int getNodeCount() const
+	{
+		return (int)nodes.size();
+	}
+
+private:
+	struct Node
+	{
+		AABB bounds;
+		int first;
+		int count;
+		int left;	// children are stored next to each other, -1 for leaves
+	};
+
+	// fills the already allocated node at index with the items [first, first + count)
+	void buildNode(const std::vector<AABB>& bounds, int index, int first, int count)
+	{
+		AABB box, centers;
+		for (int i = first; i < first + count; i++)
+		{
+			box.expand(bounds[items[i]]);
+			glm::vec3 c = bounds[items[i]].center();
+			centers.expand(AABB(c, c));
+		}
+		nodes[index].bounds = box;
+		nodes[index].first = first;
+		nodes[index].count = count;
+		nodes[index].left = -1;
+		if (count <= LEAF_SIZE)
+			return;
+
+		glm::vec3 size = centers.max - centers.min;
+		int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+		int half = count / 2;
+		std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+			[&bounds, axis](int a, int b) { return bounds[a].center()[axis] < bounds[b].center()[axis]; });
+
+		// both children are allocated together so they end up adjacent
+		int left = (int)nodes.size();
+		nodes.push_back(Node());
+		nodes.push_back(Node());
+		nodes[index].left = left;
+		buildNode(bounds, left, first, half);
+		buildNode(bounds, left + 1, first + half, count - half);
+	}
+
+	std::vector<Node> nodes;
+	std::vector<int> items;
+};
+
+#endif
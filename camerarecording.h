@@ -0,0 +1,158 @@
+#ifndef CAMERA_RECORDING_H
+#define CAMERA_RECORDING_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// per-frame camera state, recorded from a live session and replayed at a fixed timestep
+// so two runs of the same build (or of two builds) render identical frames. input only
+// ever moves the camera or toggles ortho, so the state is all a replay needs.
+//
+// file layout: Header, then header.frames Frame records
+class CameraRecording
+{
+public:
+	static const uint32_t VERSION = 2;
+
+	struct Header
+	{
+		char magic[4];			// "VLCR"
+		uint32_t version;
+		uint32_t frames;
+		float timestep;			// seconds per frame on replay
+	};
+
+	struct Frame
+	{
+		float position[3];
+		float front[3];
+		float fov;
+		float deltaTime;		// as recorded, replay uses the fixed timestep instead
+		uint32_t ortho;
+	};
+
+	static_assert(sizeof(Header) == 16, "camera recording header must have no padding");
+	static_assert(sizeof(Frame) == 36, "camera recording frame must have no padding");
+
+	CameraRecording()
+		: timestep(1.0f / 60.0f)
+	{
+	}
+
+	// appends the camera state of the current frame
+	// ------------------------------------------------------------------------
+	void record(const glm::vec3& position, const glm::vec3& front, float fov, bool isOrtho, float deltaTime)
+	{
+		Frame frame;
+		frame.position[0] = position.x;
+		frame.position[1] = position.y;
+		frame.position[2] = position.z;
+		frame.front[0] = front.x;
+		frame.front[1] = front.y;
+		frame.front[2] = front.z;
+		frame.fov = fov;
+		frame.deltaTime = deltaTime;
+		frame.ortho = isOrtho ? 1 : 0;
+		frames.push_back(frame);
+	}
+
+	// sets the camera to its recorded state at frame
+	// ------------------------------------------------------------------------
+	void apply(int frame, glm::vec3& position, glm::vec3& front, float& fov, bool& isOrtho) const
+	{
+		if (frame < 0 || frame >= (int)frames.size())
+			return;
+		const Frame& f = frames[frame];
+		position = glm::vec3(f.position[0], f.position[1], f.position[2]);
+		front = glm::vec3(f.front[0], f.front[1], f.front[2]);
+		fov = f.fov;
+		isOrtho = f.ortho != 0;
+	}
+
+	bool save(const std::string& path) const
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			std::cout << "Failed to write camera recording: " << path << std::endl;
+			return false;
+		}
+		Header header;
+		header.magic[0] = 'V';
+		header.magic[1] = 'L';
+		header.magic[2] = 'C';
+		header.magic[3] = 'R';
+		header.version = VERSION;
+		header.frames = (uint32_t)frames.size();
+		header.timestep = timestep;
+		bool ok = fwrite(&header, sizeof(Header), 1, file) == 1;
+		if (!frames.empty())
+			ok = ok && fwrite(&frames[0], sizeof(Frame), frames.size(), file) == frames.size();
+		ok = (fclose(file) == 0) && ok;
+		return ok;
+	}
+
+	bool load(const std::string& path)
+	{
+		frames.clear();
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+		{
+			std::cout << "Failed to open camera recording: " << path << std::endl;
+			return false;
+		}
+		Header header;
+		bool ok = fread(&header, sizeof(Header), 1, file) == 1;
+		ok = ok && header.magic[0] == 'V' && header.magic[1] == 'L' && header.magic[2] == 'C' && header.magic[3] == 'R';
+		ok = ok && header.version == VERSION && header.timestep > 0.0f;
+		if (ok)
+		{
+			// a damaged header must not make us allocate more frames than the file holds
+			long start = ftell(file);
+			ok = fseek(file, 0, SEEK_END) == 0;
+			long end = ftell(file);
+			ok = ok && start >= 0 && end >= start && (uint64_t)header.frames * sizeof(Frame) <= (uint64_t)(end - start);
+			ok = ok && fseek(file, start, SEEK_SET) == 0;
+		}
+		if (ok)
+		{
+			frames.resize(header.frames);
+			if (!frames.empty())
+				ok = fread(&frames[0], sizeof(Frame), frames.size(), file) == frames.size();
+			timestep = header.timestep;
+		}
+		fclose(file);
+		if (!ok)
+		{
+			std::cout << "Invalid camera recording: " << path << std::endl;
+			frames.clear();
+		}
+		return ok;
+	}
+
+	int frameCount() const
+	{
+		return (int)frames.size();
+	}
+
+	float getTimestep() const
+	{
+		return timestep;
+	}
+
+	void setTimestep(float seconds)
+	{
+		timestep = seconds;
+	}
+
+private:
+	std::vector<Frame> frames;
+	float timestep;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef CAMERA_UNIFORMS_H
+#define CAMERA_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// per-frame camera state in a std140 uniform block shared by every shader program:
+//
+//	layout (std140) uniform Camera
+//	{
+//		mat4 view;
+//		mat4 projection;
+//		mat4 viewProjection;
+//		vec4 cameraPos;
+//	};
+//
+// the matrices are only recomputed when their inputs change and the buffer is only
+// uploaded when something did, instead of once per program per frame
+class CameraUniforms
+{
+public:
+	static const unsigned int BINDING = 0;
+
+	CameraUniforms()
+		: fov(0.0f), isOrtho(false), width(0), height(0), projectionValid(false), viewValid(false), dirty(true),
+		view(1.0f), projection(1.0f), viewProjection(1.0f)
+	{
+		glGenBuffers(1, &UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, BLOCK_SIZE, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+	}
+
+	CameraUniforms(const CameraUniforms&) = delete;
+	CameraUniforms& operator=(const CameraUniforms&) = delete;
+
+	// points the program's Camera block at the shared binding; returns false if the
+	// program does not declare the block
+	// ------------------------------------------------------------------------
+	bool attach(unsigned int program)
+	{
+		unsigned int index = glGetUniformBlockIndex(program, "Camera");
+		if (index == GL_INVALID_INDEX)
+			return false;
+		glUniformBlockBinding(program, index, BINDING);
+		return true;
+	}
+
+	// rebuilds the projection only if the field of view, mode or framebuffer size changed
+	// ------------------------------------------------------------------------
+	void setProjection(float newFov, bool newIsOrtho, int newWidth, int newHeight)
+	{
+		if (projectionValid && newFov == fov && newIsOrtho == isOrtho && newWidth == width && newHeight == height)
+			return;
+		fov = newFov;
+		isOrtho = newIsOrtho;
+		width = newWidth;
+		height = newHeight;
+		if (width <= 0 || height <= 0)
+			return;
+
+		projection = buildProjection(fov, isOrtho, width, height);
+		projectionValid = true;
+		dirty = true;
+	}
+
+	// the projection setProjection() uses, for code that needs it without the buffer
+	// ------------------------------------------------------------------------
+	static glm::mat4 buildProjection(float fov, bool isOrtho, int width, int height)
+	{
+		if (isOrtho)
+		{
+			// fixed bounds, whatever the framebuffer size
+			float scale = 20;
+			return glm::ortho(-(800.0f / scale), 800.0f / scale, 600.0f / scale, -(600.0f / scale), 5.0f, -5.0f);
+		}
+		return glm::perspective(glm::radians(fov), (float)width / (float)height, 0.1f, 100.0f);
+	}
+
+	// rebuilds the view only if the camera moved or turned
+	// ------------------------------------------------------------------------
+	void setView(const glm::vec3& newPosition, const glm::vec3& newFront, const glm::vec3& newUp)
+	{
+		if (viewValid && newPosition == position && newFront == front && newUp == up)
+			return;
+		position = newPosition;
+		front = newFront;
+		up = newUp;
+		view = glm::lookAt(position, position + front, up);
+		viewValid = true;
+		dirty = true;
+	}
+
+	// uploads the block if anything changed since the last call
+	// ------------------------------------------------------------------------
+	void update()
+	{
+		if (!dirty)
+			return;
+		viewProjection = projection * view;
+		glm::vec4 cameraPos(position, 1.0f);
+
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(glm::mat4), glm::value_ptr(view));
+		glBufferSubData(GL_UNIFORM_BUFFER, 64, sizeof(glm::mat4), glm::value_ptr(projection));
+		glBufferSubData(GL_UNIFORM_BUFFER, 128, sizeof(glm::mat4), glm::value_ptr(viewProjection));
+		glBufferSubData(GL_UNIFORM_BUFFER, 192, sizeof(glm::vec4), glm::value_ptr(cameraPos));
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		dirty = false;
+	}
+
+	const glm::mat4& getView() const
+	{
+		return view;
+	}
+
+	const glm::mat4& getProjection() const
+	{
+		return projection;
+	}
+
+	const glm::mat4& getViewProjection() const
+	{
+		return viewProjection;
+	}
+
+	void deleteBuffer()
+	{
+		glDeleteBuffers(1, &UBO);
+		UBO = 0;
+	}
+
+	unsigned int UBO;
+
+private:
+	static const int BLOCK_SIZE = 3 * 64 + 16;
+
+	float fov;
+	bool isOrtho;
+	int width, height;
+	glm::vec3 position, front, up;
+	bool projectionValid, viewValid, dirty;
+
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 viewProjection;
+};
+
+#endif
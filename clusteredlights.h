@@ -0,0 +1,441 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "jobsystem.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLUSTERED_LIGHTS_SSE 1
+#endif
+
+// a point light whose contribution falls off smoothly to zero at its radius
+struct PointLight
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+	float intensity;
+};
+
+// clustered forward shading (Olsson et al. 2012): the view frustum is split into a grid of
+// CLUSTERS_X x CLUSTERS_Y screen tiles by CLUSTERS_Z depth slices, spaced exponentially for
+// perspective views. every frame each light is tested against the view space bounds of
+// the clusters its sphere can reach, four clusters at a time with SSE, and the result is
+// uploaded as three buffer textures:
+//
+//	lights			RGBA32F, two texels per light: position and radius, color and intensity
+//	clusters		RG32UI, offset and count of each cluster's entries in lightIndices
+//	lightIndices	R16UI, the lights of every cluster back to back
+//
+// with a job system set, the lights are assigned in parallel in fixed runs of
+// LIGHTS_PER_JOB whose results are merged in order, so the lists match a serial update.
+//
+// a lit fragment shader (7.6.clustered.fs) finds its cluster from gl_FragCoord and its view
+// depth and only evaluates the lights listed there. the grid parameters live in a std140
+// uniform block next to the Camera block:
+//
+//	layout (std140) uniform Clusters
+//	{
+//		uvec4 clusterCounts;	// x, y and z, w is 1 for logarithmic slices
+//		vec4 clusterScale;		// tiles per pixel in x and y, slice scale and bias
+//		vec4 ambient;
+//	};
+class ClusteredLights
+{
+public:
+	static const int CLUSTERS_X = 16;
+	static const int CLUSTERS_Y = 9;
+	static const int CLUSTERS_Z = 24;
+	static const int CLUSTER_COUNT = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+	static const size_t MAX_LIGHTS = 65536;	// 16-bit light indices
+	static const unsigned int BINDING = 1;	// the Camera block uses 0
+	// unit 0 holds the texture array and TextureArray copies mip levels through unit 1
+	static const int FIRST_TEXTURE_UNIT = 2;
+	static const size_t LIGHTS_PER_JOB = 256;
+
+	static_assert(sizeof(PointLight) == 8 * sizeof(float), "PointLight is uploaded as two RGBA32F texels");
+
+	ClusteredLights()
+		: ambient(0.1f), projection(0.0f), width(0), height(0), logarithmic(true),
+		minDepth(0.1f), maxDepth(100.0f), sliceScale(0.0f), sliceBias(0.0f), uniformsDirty(true), jobs(NULL)
+	{
+		glGenBuffers(3, buffers);
+		glGenTextures(3, textures);
+		const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+		for (int i = 0; i < 3; i++)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+			glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+		}
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glGenBuffers(1, &UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, BLOCK_SIZE, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, UBO);
+
+		const size_t padded = CLUSTER_COUNT + 3;	// rows are read four clusters at a time
+		boxMinX.assign(padded, 0.0f);
+		boxMinY.assign(padded, 0.0f);
+		boxMinZ.assign(padded, 0.0f);
+		boxMaxX.assign(padded, 0.0f);
+		boxMaxY.assign(padded, 0.0f);
+		boxMaxZ.assign(padded, 0.0f);
+		grid.assign(2 * CLUSTER_COUNT, 0);
+		fill.assign(CLUSTER_COUNT, 0);
+	}
+
+	ClusteredLights(const ClusteredLights&) = delete;
+	ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+	// points the program's Clusters block and light samplers at the shared bindings;
+	// returns false if the program does not declare the block
+	// ------------------------------------------------------------------------
+	bool attach(unsigned int program)
+	{
+		unsigned int index = glGetUniformBlockIndex(program, "Clusters");
+		if (index == GL_INVALID_INDEX)
+			return false;
+		glUniformBlockBinding(program, index, BINDING);
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "lights"), FIRST_TEXTURE_UNIT);
+		glUniform1i(glGetUniformLocation(program, "clusters"), FIRST_TEXTURE_UNIT + 1);
+		glUniform1i(glGetUniformLocation(program, "lightIndices"), FIRST_TEXTURE_UNIT + 2);
+		return true;
+	}
+
+	// spreads the light assignment over the job system's threads; NULL runs it serially
+	// ------------------------------------------------------------------------
+	void setJobSystem(JobSystem* jobSystem)
+	{
+		jobs = jobSystem;
+	}
+
+	void setAmbient(const glm::vec3& newAmbient)
+	{
+		if (newAmbient == ambient)
+			return;
+		ambient = newAmbient;
+		uniformsDirty = true;
+	}
+
+	// assigns the lights to the clusters of this view and uploads the result. the
+	// cluster bounds are only rebuilt when the projection or framebuffer size changed
+	// ------------------------------------------------------------------------
+	void update(const glm::mat4& view, const glm::mat4& newProjection, int newWidth, int newHeight)
+	{
+		if (newWidth <= 0 || newHeight <= 0)
+			return;
+		if (newProjection != projection || newWidth != width || newHeight != height)
+		{
+			projection = newProjection;
+			width = newWidth;
+			height = newHeight;
+			buildClusters();
+		}
+		if (uniformsDirty)
+			uploadUniforms();
+		assignLights(view);
+		uploadLights();
+	}
+
+	// binds the light buffer textures for the lit programs
+	// ------------------------------------------------------------------------
+	void bind() const
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + i);
+			glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// light references over all clusters in the last update
+	size_t getIndexCount() const
+	{
+		return indices.size();
+	}
+
+	void deleteBuffers()
+	{
+		glDeleteTextures(3, textures);
+		glDeleteBuffers(3, buffers);
+		glDeleteBuffers(1, &UBO);
+		UBO = 0;
+	}
+
+	// world space lights, edited freely between updates; only the first MAX_LIGHTS are used
+	std::vector<PointLight> lights;
+
+private:
+	static const int BLOCK_SIZE = 3 * 16;
+
+	// view depth (positive in front of the camera) where slice begins
+	float sliceDepth(int slice) const
+	{
+		float t = (float)slice / CLUSTERS_Z;
+		if (logarithmic)
+			return minDepth * std::pow(maxDepth / minDepth, t);
+		return minDepth + (maxDepth - minDepth) * t;
+	}
+
+	int sliceOf(float depth) const
+	{
+		float s = (logarithmic ? std::log2(depth) : depth) * sliceScale + sliceBias;
+		return std::min(std::max((int)s, 0), CLUSTERS_Z - 1);
+	}
+
+	// view space point at a view depth that projects to the given x and y in NDC; works
+	// for perspective and orthographic projections alike
+	glm::vec3 unproject(float ndcX, float ndcY, float depth) const
+	{
+		const glm::mat4& p = projection;
+		float z = -depth;
+		float w = p[2][3] * z + p[3][3];
+		return glm::vec3((ndcX * w - p[2][0] * z - p[3][0]) / p[0][0], (ndcY * w - p[2][1] * z - p[3][1]) / p[1][1], z);
+	}
+
+	glm::vec2 project(const glm::vec3& v) const
+	{
+		const glm::mat4& p = projection;
+		float w = p[2][3] * v.z + p[3][3];
+		return glm::vec2(p[0][0] * v.x + p[2][0] * v.z + p[3][0], p[1][1] * v.y + p[2][1] * v.z + p[3][1]) / w;
+	}
+
+	// view space bounds of every cluster, stored one component per array so a row of
+	// clusters can be tested four at a time
+	void buildClusters()
+	{
+		const glm::mat4& p = projection;
+		logarithmic = p[2][3] != 0.0f;
+		float nearDepth, farDepth;
+		if (logarithmic)
+		{
+			nearDepth = p[3][2] / (p[2][2] - 1.0f);
+			farDepth = p[3][2] / (p[2][2] + 1.0f);
+		}
+		else
+		{
+			nearDepth = (p[3][2] + 1.0f) / p[2][2];
+			farDepth = (p[3][2] - 1.0f) / p[2][2];
+		}
+		minDepth = std::min(nearDepth, farDepth);
+		maxDepth = std::max(nearDepth, farDepth);
+		if (logarithmic)
+		{
+			sliceScale = CLUSTERS_Z / std::log2(maxDepth / minDepth);
+			sliceBias = -std::log2(minDepth) * sliceScale;
+		}
+		else
+		{
+			sliceScale = CLUSTERS_Z / (maxDepth - minDepth);
+			sliceBias = -minDepth * sliceScale;
+		}
+
+		for (int z = 0; z < CLUSTERS_Z; z++)
+		{
+			float depths[2] = { sliceDepth(z), sliceDepth(z + 1) };
+			for (int y = 0; y < CLUSTERS_Y; y++)
+			{
+				for (int x = 0; x < CLUSTERS_X; x++)
+				{
+					glm::vec3 lo(1e30f), hi(-1e30f);
+					for (int corner = 0; corner < 8; corner++)
+					{
+						float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / CLUSTERS_X;
+						float ndcY = -1.0f + 2.0f * (y + ((corner >> 1) & 1)) / CLUSTERS_Y;
+						glm::vec3 v = unproject(ndcX, ndcY, depths[corner >> 2]);
+						lo = glm::min(lo, v);
+						hi = glm::max(hi, v);
+					}
+					int i = (z * CLUSTERS_Y + y) * CLUSTERS_X + x;
+					boxMinX[i] = lo.x;
+					boxMinY[i] = lo.y;
+					boxMinZ[i] = lo.z;
+					boxMaxX[i] = hi.x;
+					boxMaxY[i] = hi.y;
+					boxMaxZ[i] = hi.z;
+				}
+			}
+		}
+		uniformsDirty = true;
+	}
+
+	void uploadUniforms()
+	{
+		const uint32_t counts[4] = { CLUSTERS_X, CLUSTERS_Y, CLUSTERS_Z, logarithmic ? 1u : 0u };
+		const float scale[4] = { (float)CLUSTERS_X / width, (float)CLUSTERS_Y / height, sliceScale, sliceBias };
+		const float ambientColor[4] = { ambient.x, ambient.y, ambient.z, 1.0f };
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(counts), counts);
+		glBufferSubData(GL_UNIFORM_BUFFER, 16, sizeof(scale), scale);
+		glBufferSubData(GL_UNIFORM_BUFFER, 32, sizeof(ambientColor), ambientColor);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		uniformsDirty = false;
+	}
+
+	// clusters of one row (x0..x1 inclusive) touched by a view space sphere, appended
+	// to out as cluster << 16 | light
+	void testRow(int row, int x0, int x1, const glm::vec3& c, float radius2, uint32_t light, std::vector<uint32_t>& out) const
+	{
+#ifdef CLUSTERED_LIGHTS_SSE
+		const __m128 cx = _mm_set1_ps(c.x);
+		const __m128 cy = _mm_set1_ps(c.y);
+		const __m128 cz = _mm_set1_ps(c.z);
+		const __m128 r2 = _mm_set1_ps(radius2);
+		const __m128 zero = _mm_setzero_ps();
+		for (int x = x0; x <= x1; x += 4)
+		{
+			const int i = row + x;
+			// distance from the sphere center to each box, per axis
+			__m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinX[i]), cx), zero), _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(&boxMaxX[i])), zero));
+			__m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinY[i]), cy), zero), _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(&boxMaxY[i])), zero));
+			__m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&boxMinZ[i]), cz), zero), _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(&boxMaxZ[i])), zero));
+			__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			int mask = _mm_movemask_ps(_mm_cmple_ps(d2, r2)) & ((1 << std::min(4, x1 - x + 1)) - 1);
+			for (int b = 0; b < 4; b++)
+			{
+				if (mask & (1 << b))
+					out.push_back((uint32_t)(i + b) << 16 | light);
+			}
+		}
+#else
+		for (int x = x0; x <= x1; x++)
+		{
+			const int i = row + x;
+			float dx = std::max(boxMinX[i] - c.x, 0.0f) + std::max(c.x - boxMaxX[i], 0.0f);
+			float dy = std::max(boxMinY[i] - c.y, 0.0f) + std::max(c.y - boxMaxY[i], 0.0f);
+			float dz = std::max(boxMinZ[i] - c.z, 0.0f) + std::max(c.z - boxMaxZ[i], 0.0f);
+			if (dx * dx + dy * dy + dz * dz <= radius2)
+				out.push_back((uint32_t)i << 16 | light);
+		}
+#endif
+	}
+
+	// appends the clusters touched by light l to out
+	void assignLight(size_t l, const glm::mat4& view, std::vector<uint32_t>& out) const
+	{
+		const glm::vec3 c = glm::vec3(view * glm::vec4(lights[l].position, 1.0f));
+		const float r = lights[l].radius;
+		if (-c.z + r < minDepth || -c.z - r > maxDepth)
+			return;
+
+		// screen rectangle: the projected corners of the sphere's box, clipped to the
+		// depth range so no corner ends up behind the camera
+		glm::vec2 lo(1e30f), hi(-1e30f);
+		for (int corner = 0; corner < 8; corner++)
+		{
+			float depth = std::min(std::max(-c.z + ((corner & 4) ? r : -r), minDepth), maxDepth);
+			glm::vec2 ndc = project(glm::vec3(c.x + ((corner & 1) ? r : -r), c.y + ((corner & 2) ? r : -r), -depth));
+			lo = glm::min(lo, ndc);
+			hi = glm::max(hi, ndc);
+		}
+		if (hi.x < -1.0f || lo.x > 1.0f || hi.y < -1.0f || lo.y > 1.0f)
+			return;
+		const int x0 = std::max((int)std::floor((lo.x + 1.0f) * 0.5f * CLUSTERS_X), 0);
+		const int x1 = std::min((int)std::floor((hi.x + 1.0f) * 0.5f * CLUSTERS_X), CLUSTERS_X - 1);
+		const int y0 = std::max((int)std::floor((lo.y + 1.0f) * 0.5f * CLUSTERS_Y), 0);
+		const int y1 = std::min((int)std::floor((hi.y + 1.0f) * 0.5f * CLUSTERS_Y), CLUSTERS_Y - 1);
+		const int z0 = sliceOf(std::max(-c.z - r, minDepth));
+		const int z1 = sliceOf(std::min(-c.z + r, maxDepth));
+
+		for (int z = z0; z <= z1; z++)
+		{
+			for (int y = y0; y <= y1; y++)
+				testRow((z * CLUSTERS_Y + y) * CLUSTERS_X, x0, x1, c, r * r, (uint32_t)l, out);
+		}
+	}
+
+	// finds the clusters of every light and sorts the pairs into per cluster lists
+	void assignLights(const glm::mat4& view)
+	{
+		static_assert(CLUSTER_COUNT < 65536, "cluster indices are packed into 16 bits");
+		pairs.clear();
+		const size_t lightCount = std::min(lights.size(), (size_t)MAX_LIGHTS);
+		if (jobs && lightCount > LIGHTS_PER_JOB)
+		{
+			jobPairs.resize((lightCount + LIGHTS_PER_JOB - 1) / LIGHTS_PER_JOB);
+			jobs->parallelFor(0, lightCount, LIGHTS_PER_JOB, [&](size_t first, size_t last)
+			{
+				std::vector<uint32_t>& out = jobPairs[first / LIGHTS_PER_JOB];
+				out.clear();
+				for (size_t l = first; l < last; l++)
+					assignLight(l, view, out);
+			});
+			for (size_t i = 0; i < jobPairs.size(); i++)
+				pairs.insert(pairs.end(), jobPairs[i].begin(), jobPairs[i].end());
+		}
+		else
+		{
+			for (size_t l = 0; l < lightCount; l++)
+				assignLight(l, view, pairs);
+		}
+
+		// counting sort by cluster; lights keep their order within a cluster
+		for (int i = 0; i < CLUSTER_COUNT; i++)
+			grid[2 * i + 1] = 0;
+		for (size_t i = 0; i < pairs.size(); i++)
+			grid[2 * (pairs[i] >> 16) + 1]++;
+		uint32_t offset = 0;
+		for (int i = 0; i < CLUSTER_COUNT; i++)
+		{
+			grid[2 * i] = fill[i] = offset;
+			offset += grid[2 * i + 1];
+		}
+		indices.resize(pairs.size());
+		for (size_t i = 0; i < pairs.size(); i++)
+			indices[fill[pairs[i] >> 16]++] = (uint16_t)(pairs[i] & 0xFFFF);
+	}
+
+	// orphans and refills the three buffers
+	void uploadLights()
+	{
+		const size_t lightCount = std::min(lights.size(), (size_t)MAX_LIGHTS);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[0]);
+		glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(lightCount, 1) * sizeof(PointLight), NULL, GL_STREAM_DRAW);
+		if (lightCount)
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, lightCount * sizeof(PointLight), &lights[0]);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[1]);
+		glBufferData(GL_TEXTURE_BUFFER, grid.size() * sizeof(uint32_t), &grid[0], GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffers[2]);
+		glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(indices.size(), 1) * sizeof(uint16_t), NULL, GL_STREAM_DRAW);
+		if (!indices.empty())
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, indices.size() * sizeof(uint16_t), &indices[0]);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	unsigned int buffers[3];	// lights, clusters, lightIndices
+	unsigned int textures[3];
+	unsigned int UBO;
+
+	glm::vec3 ambient;
+	glm::mat4 projection;
+	int width, height;
+	bool logarithmic;
+	float minDepth, maxDepth;	// view depth range of the projection
+	float sliceScale, sliceBias;
+	bool uniformsDirty;
+	JobSystem* jobs;
+
+	std::vector<float> boxMinX, boxMinY, boxMinZ, boxMaxX, boxMaxY, boxMaxZ;
+	std::vector<uint32_t> pairs;	// cluster << 16 | light
+	std::vector<std::vector<uint32_t> > jobPairs;	// pairs of each run of LIGHTS_PER_JOB lights
+	std::vector<uint32_t> grid;		// offset, count per cluster
+	std::vector<uint32_t> fill;
+	std::vector<uint16_t> indices;
+};
+
+#endif
@@ -0,0 +1,371 @@
+#ifndef FOREST_H
+#define FOREST_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "bounds.h"
+#include "jobsystem.h"
+#include "lod.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// a procedurally scattered forest. generate() spreads trees over a rectangle of the
+// ground plane with Poisson-disk spacing (Bridson 2007), so no two trunks are closer than
+// getSpacing() and there are no clumps or gaps, then gives every tree its own scale and
+// rotation. the same seed always gives the same forest: random numbers come straight from
+// std::mt19937, whose sequence the standard fixes, instead of the distributions, which
+// differ between standard libraries.
+//
+// the trees are sorted into a uniform grid of square cells, each holding a contiguous
+// range of trees and their bounds. update() culls whole cells against the view frustum
+// and a streaming distance and picks one trunk level of detail per cell; gather() then
+// builds the instance transforms of just those cells. a tree is a trunk and a canopy
+// with the proportions of the first hand-placed tree, above a root transform on the ground
+class Forest
+{
+public:
+	static const int MAX_TREES = 1000000;
+	static const int CELL_SPACINGS = 16;	// cell size in multiples of the tree spacing
+
+	struct Tree
+	{
+		glm::vec3 position;		// root, on the ground
+		float scale;
+		float angle;			// rotation about the vertical axis in radians
+	};
+
+	struct Cell
+	{
+		AABB bounds;			// of every trunk and canopy in the cell
+		int first;				// trees[first, first + count)
+		int count;
+	};
+
+	// a cell that passed update(), with the trunk level its trees are drawn at
+	struct Visible
+	{
+		int cell;
+		int level;
+
+		bool operator==(const Visible& other) const
+		{
+			return cell == other.cell && level == other.level;
+		}
+	};
+
+	// mesh bounds are in the meshes' own space, before the tree transforms
+	Forest(const AABB& trunkMeshBounds, const AABB& canopyMeshBounds)
+		: trunkMeshBounds(trunkMeshBounds), canopyMeshBounds(canopyMeshBounds), spacing(0.0f), cellSize(1.0f),
+		cellsX(0), cellsZ(0), version(0)
+	{
+		trunkLocal = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 5.0f, 0.0f)), glm::vec3(0.2f, 1.0f, 0.2f));
+		canopyLocal = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 8.0f, 0.0f)), glm::vec3(4.0f, 8.0f, 4.0f));
+	}
+
+	// replaces the forest with about count trees on [areaMin, areaMax] in x and z; scales
+	// vary by up to scaleVariance either way. returns the number of trees placed
+	// ------------------------------------------------------------------------
+	int generate(int count, const glm::vec2& areaMin, const glm::vec2& areaMax, uint32_t seed, float scaleVariance = 0.25f)
+	{
+		trees.clear();
+		cells.clear();
+		levels.clear();
+		bounds = AABB();
+		version++;
+		count = std::min(count, (int)MAX_TREES);
+		const glm::vec2 size = areaMax - areaMin;
+		if (count <= 0 || size.x <= 0.0f || size.y <= 0.0f)
+			return 0;
+
+		// a maximal Poisson-disk set holds about 0.88 points per spacing squared; aiming a
+		// little denser and dropping the surplus evenly keeps the whole area covered
+		spacing = std::sqrt(PACKING * size.x * size.y / count);
+		std::mt19937 random(seed);
+		std::vector<glm::vec2> points;
+		poissonDisk(areaMin, size, random, points);
+		for (size_t i = 0; i < (size_t)count && i < points.size(); i++)
+			std::swap(points[i], points[i + random() % (points.size() - i)]);
+		points.resize(std::min(points.size(), (size_t)count));
+
+		trees.resize(points.size());
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			trees[i].position = glm::vec3(points[i].x, 0.0f, points[i].y);
+			trees[i].scale = 1.0f + scaleVariance * (2.0f * unit(random) - 1.0f);
+			trees[i].angle = 6.2831853f * unit(random);
+		}
+		buildGrid(areaMin, size);
+		return (int)trees.size();
+	}
+
+	// culls the cells against frustum and maxDistance from eye and chooses the trunk level
+	// of each visible cell from the size of a tree at its nearest point; levels keep their
+	// hysteresis per cell between calls
+	// ------------------------------------------------------------------------
+	void update(const Frustum& frustum, const glm::vec3& eye, float maxDistance, const LodSelector& lod, const glm::mat4& projection, int viewportHeight,
+		std::vector<Visible>& visible)
+	{
+		visible.clear();
+		const glm::vec3 trunkExtents = trunkMeshBounds.transformed(trunkLocal).extents();
+		for (size_t i = 0; i < cells.size(); i++)
+		{
+			const Cell& cell = cells[i];
+			if (cell.count == 0)
+				continue;
+			const glm::vec3 nearest = glm::clamp(eye, cell.bounds.min, cell.bounds.max);
+			if (glm::length(nearest - eye) > maxDistance || frustum.test(cell.bounds) == Frustum::OUTSIDE)
+				continue;
+			float size = projectedSize(AABB(nearest - trunkExtents, nearest + trunkExtents), eye, projection, viewportHeight);
+			levels[i] = lod.select(levels[i], size);
+			Visible entry;
+			entry.cell = (int)i;
+			entry.level = levels[i];
+			visible.push_back(entry);
+		}
+	}
+
+	// instance transforms of the trees in visible: trunks per level (levelCount lists)
+	// and canopies, in cell order so the result does not depend on the thread count
+	// ------------------------------------------------------------------------
+	void gather(const std::vector<Visible>& visible, int levelCount, std::vector<std::vector<glm::mat4> >& trunks, std::vector<glm::mat4>& canopies,
+		JobSystem& jobs) const
+	{
+		std::vector<size_t> trunkOffsets(visible.size()), canopyOffsets(visible.size());
+		std::vector<size_t> levelSizes(levelCount, 0);
+		size_t canopyCount = 0;
+		for (size_t i = 0; i < visible.size(); i++)
+		{
+			const int level = std::min(visible[i].level, levelCount - 1);
+			const int count = cells[visible[i].cell].count;
+			trunkOffsets[i] = levelSizes[level];
+			levelSizes[level] += count;
+			canopyOffsets[i] = canopyCount;
+			canopyCount += count;
+		}
+		trunks.resize(levelCount);
+		for (int level = 0; level < levelCount; level++)
+			trunks[level].resize(levelSizes[level]);
+		canopies.resize(canopyCount);
+
+		jobs.parallelFor(0, visible.size(), 4, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+			{
+				const Cell& cell = cells[visible[i].cell];
+				glm::mat4* trunk = &trunks[std::min(visible[i].level, levelCount - 1)][trunkOffsets[i]];
+				glm::mat4* canopy = &canopies[canopyOffsets[i]];
+				for (int t = 0; t < cell.count; t++)
+				{
+					const glm::mat4 root = rootTransform(trees[cell.first + t]);
+					trunk[t] = root * trunkLocal;
+					canopy[t] = root * canopyLocal;
+				}
+			}
+		});
+	}
+
+	// trees in the cells of visible
+	// ------------------------------------------------------------------------
+	size_t countTrees(const std::vector<Visible>& visible) const
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < visible.size(); i++)
+			total += cells[visible[i].cell].count;
+		return total;
+	}
+
+	int getTreeCount() const
+	{
+		return (int)trees.size();
+	}
+
+	int getCellCount() const
+	{
+		return (int)cells.size();
+	}
+
+	const Cell& getCell(int cell) const
+	{
+		return cells[cell];
+	}
+
+	float getSpacing() const
+	{
+		return spacing;
+	}
+
+	// bounds of the whole forest, empty without trees
+	const AABB& getBounds() const
+	{
+		return bounds;
+	}
+
+	// changes with every generate(), for caches of gathered instances
+	int getVersion() const
+	{
+		return version;
+	}
+
+private:
+	static const int ATTEMPTS = 30;			// candidates tried around a point before it is retired
+	static constexpr float RING = 1.0001f;	// candidate distance in spacings, see poissonDisk()
+	static constexpr float PACKING = 0.8f;	// requested spacing squared per tree, see generate()
+
+	// uniform float in [0, 1) from the top 24 bits of the generator
+	static float unit(std::mt19937& random)
+	{
+		return (random() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	static glm::mat4 rootTransform(const Tree& tree)
+	{
+		glm::mat4 root = glm::translate(glm::mat4(1.0f), tree.position);
+		root = glm::rotate(root, tree.angle, glm::vec3(0.0f, 1.0f, 0.0f));
+		return glm::scale(root, glm::vec3(tree.scale));
+	}
+
+	// Bridson's algorithm with the candidates placed evenly on a ring just outside the
+	// spacing instead of randomly in the annulus out to twice it, which packs tighter and
+	// rejects fewer candidates. the newest active point grows the set, so the work stays
+	// in cache; a background grid with cells of spacing / sqrt(2) holds at most one point
+	// each, so a candidate only has to be compared with the points of the 5x5 cells around it
+	void poissonDisk(const glm::vec2& origin, const glm::vec2& size, std::mt19937& random, std::vector<glm::vec2>& points) const
+	{
+		const float gridCell = spacing / std::sqrt(2.0f);
+		const int gridX = std::max((int)std::ceil(size.x / gridCell), 1);
+		const int gridZ = std::max((int)std::ceil(size.y / gridCell), 1);
+		std::vector<int> grid((size_t)gridX * gridZ, -1);
+		std::vector<int> active;
+
+		points.clear();
+		points.push_back(origin + size * glm::vec2(unit(random), unit(random)));
+		grid[cellIndex(points[0] - origin, gridCell, gridX, gridZ)] = 0;
+		active.push_back(0);
+
+		const float spacing2 = spacing * spacing;
+		glm::vec2 ring[ATTEMPTS];
+		for (int i = 0; i < ATTEMPTS; i++)
+			ring[i] = glm::vec2(std::cos(6.2831853f * i / ATTEMPTS), std::sin(6.2831853f * i / ATTEMPTS));
+		while (!active.empty())
+		{
+			const size_t slot = active.size() - 1;
+			const glm::vec2 center = points[active[slot]];
+			bool placed = false;
+			const float start = 6.2831853f * unit(random);
+			const glm::vec2 first = RING * spacing * glm::vec2(std::cos(start), std::sin(start));
+			for (int attempt = 0; attempt < ATTEMPTS && !placed; attempt++)
+			{
+				const glm::vec2 step = ring[attempt];
+				const glm::vec2 candidate = center + glm::vec2(first.x * step.x - first.y * step.y, first.x * step.y + first.y * step.x);
+				const glm::vec2 local = candidate - origin;
+				if (local.x < 0.0f || local.y < 0.0f || local.x >= size.x || local.y >= size.y)
+					continue;
+
+				const int cx = std::min((int)(local.x / gridCell), gridX - 1);
+				const int cz = std::min((int)(local.y / gridCell), gridZ - 1);
+				bool free = true;
+				for (int z = std::max(cz - 2, 0); z <= std::min(cz + 2, gridZ - 1) && free; z++)
+				{
+					for (int x = std::max(cx - 2, 0); x <= std::min(cx + 2, gridX - 1); x++)
+					{
+						const int other = grid[(size_t)z * gridX + x];
+						if (other >= 0)
+						{
+							const glm::vec2 offset = points[other] - candidate;
+							if (glm::dot(offset, offset) < spacing2)
+							{
+								free = false;
+								break;
+							}
+						}
+					}
+				}
+				if (!free)
+					continue;
+				grid[(size_t)cz * gridX + cx] = (int)points.size();
+				active.push_back((int)points.size());
+				points.push_back(candidate);
+				placed = true;
+			}
+			if (!placed)
+			{
+				active[slot] = active.back();
+				active.pop_back();
+			}
+		}
+	}
+
+	static size_t cellIndex(const glm::vec2& local, float cell, int countX, int countZ)
+	{
+		const int x = std::min(std::max((int)(local.x / cell), 0), countX - 1);
+		const int z = std::min(std::max((int)(local.y / cell), 0), countZ - 1);
+		return (size_t)z * countX + x;
+	}
+
+	// sorts the trees by streaming cell (a counting sort, so trees keep their order within
+	// a cell) and bounds every cell
+	void buildGrid(const glm::vec2& origin, const glm::vec2& size)
+	{
+		cellSize = spacing * CELL_SPACINGS;
+		cellsX = std::max((int)std::ceil(size.x / cellSize), 1);
+		cellsZ = std::max((int)std::ceil(size.y / cellSize), 1);
+		cells.assign((size_t)cellsX * cellsZ, Cell());
+		levels.assign(cells.size(), 0);
+
+		std::vector<size_t> treeCells(trees.size());
+		for (size_t i = 0; i < trees.size(); i++)
+		{
+			treeCells[i] = cellIndex(glm::vec2(trees[i].position.x, trees[i].position.z) - origin, cellSize, cellsX, cellsZ);
+			cells[treeCells[i]].count++;
+		}
+		int offset = 0;
+		for (size_t i = 0; i < cells.size(); i++)
+		{
+			cells[i].first = offset;
+			offset += cells[i].count;
+			cells[i].count = 0;
+		}
+		std::vector<Tree> sorted(trees.size());
+		for (size_t i = 0; i < trees.size(); i++)
+		{
+			Cell& cell = cells[treeCells[i]];
+			sorted[cell.first + cell.count++] = trees[i];
+		}
+		trees.swap(sorted);
+
+		bounds = AABB();
+		for (size_t i = 0; i < cells.size(); i++)
+		{
+			Cell& cell = cells[i];
+			for (int t = 0; t < cell.count; t++)
+			{
+				const glm::mat4 root = rootTransform(trees[cell.first + t]);
+				cell.bounds.expand(trunkMeshBounds.transformed(root * trunkLocal));
+				cell.bounds.expand(canopyMeshBounds.transformed(root * canopyLocal));
+			}
+			if (cell.count > 0)
+				bounds.expand(cell.bounds);
+		}
+	}
+
+	AABB trunkMeshBounds;
+	AABB canopyMeshBounds;
+	glm::mat4 trunkLocal;
+	glm::mat4 canopyLocal;
+
+	std::vector<Tree> trees;	// sorted by cell
+	std::vector<Cell> cells;	// row major, x fastest
+	std::vector<int> levels;	// trunk level of each cell, kept for hysteresis
+	AABB bounds;
+	float spacing;
+	float cellSize;
+	int cellsX, cellsZ;
+	int version;
+};
+
+#endif
@@ -0,0 +1,381 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// records the rendered frames without stalling the renderer. glReadPixels goes into one
+// of PBOS pixel pack buffers and returns at once; the pixels are only mapped PBOS - 1
+// frames later, when the copy has long finished. mapped frames are queued for background
+// encoders, which write them as a numbered PPM sequence into a directory or as one raw
+// Y4M video (4:2:0, BT.601). at most maxQueued frames wait for an encoder: once the
+// queue is full, capture() blocks until one is taken, so a slow disk slows the frame rate
+// down instead of filling memory
+class FrameCapture
+{
+public:
+	enum Format
+	{
+		PPM_SEQUENCE,
+		Y4M
+	};
+
+	static const int PBOS = 3;
+
+	struct Stats
+	{
+		int captured;		// frames read back
+		int written;		// frames the encoders finished
+		int failed;			// frames that could not be written
+		int skipped;		// frames of the wrong size
+		int stalls;			// capture() calls that waited for a full queue
+		double stallMs;		// time spent waiting
+	};
+
+	// path names the directory of a PPM sequence or the Y4M file; frames are width x
+	// height, a Y4M video crops them to even sizes. fps only goes into the Y4M header
+	// ------------------------------------------------------------------------
+	FrameCapture(int width, int height, Format format, const std::string& path, int fps = 60, int encoderThreads = 2, int maxQueued = 8)
+		: width(width), height(height), format(format), path(path), maxQueued(std::max(maxQueued, 1)), video(NULL),
+		  nextSlot(0), nextSequence(0), closed(false), nextWrite(0)
+	{
+		memset(&stats, 0, sizeof(stats));
+		if (format == Y4M)
+		{
+			videoWidth = width & ~1;
+			videoHeight = height & ~1;
+			video = fopen(path.c_str(), "wb");
+			if (!video)
+				std::cout << "ERROR::FRAME_CAPTURE: failed to open " << path << std::endl;
+			else
+				fprintf(video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", videoWidth, videoHeight, fps);
+		}
+
+		const size_t frameBytes = (size_t)width * height * 4;
+		glGenBuffers(PBOS, PBO);
+		for (int i = 0; i < PBOS; i++)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, frameBytes, NULL, GL_STREAM_READ);
+			fences[i] = 0;
+			pending[i] = -1;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		for (int i = 0; i < std::max(encoderThreads, 1); i++)
+			encoders.push_back(std::thread(&FrameCapture::encoderLoop, this));
+	}
+
+	~FrameCapture()
+	{
+		close();
+	}
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	bool isOpen() const
+	{
+		return format != Y4M || video != NULL;
+	}
+
+	// starts reading the color buffer of framebuffer (0 is the window's back buffer, so
+	// call before swapping) and queues the frame read PBOS - 1 calls ago. index numbers
+	// the files of a PPM sequence
+	// ------------------------------------------------------------------------
+	void capture(unsigned int framebuffer, int framebufferWidth, int framebufferHeight, int index)
+	{
+		if (framebufferWidth != width || framebufferHeight != height)
+		{
+			// the video and the PBOs keep the size the capture started with
+			if (stats.skipped++ == 0)
+				std::cout << "frame capture: skipping frames while the framebuffer is not " << width << "x" << height << std::endl;
+			return;
+		}
+
+		const int slot = nextSlot;
+		nextSlot = (nextSlot + 1) % PBOS;
+		if (pending[slot] >= 0)
+			retire(slot);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO[slot]);
+		// RGBA rows of 4 byte pixels are the format drivers copy without converting
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		pending[slot] = index;
+		stats.captured++;
+	}
+
+	// queues the frames still in the PBOs, waits for the encoders and closes the output.
+	// needs the GL context; the destructor only stops the encoders
+	// ------------------------------------------------------------------------
+	void finish()
+	{
+		for (int i = 0; i < PBOS; i++)
+		{
+			const int slot = (nextSlot + i) % PBOS;
+			if (pending[slot] >= 0)
+				retire(slot);
+		}
+		close();
+	}
+
+	void deleteBuffers()
+	{
+		for (int i = 0; i < PBOS; i++)
+		{
+			if (fences[i])
+				glDeleteSync(fences[i]);
+			fences[i] = 0;
+			pending[i] = -1;
+		}
+		glDeleteBuffers(PBOS, PBO);
+	}
+
+	// safe to call once finish() returned
+	const Stats& getStats() const
+	{
+		return stats;
+	}
+
+	const std::string& getPath() const
+	{
+		return path;
+	}
+
+private:
+	struct Frame
+	{
+		int index;
+		int sequence;			// order of capture, which a video is written in
+		std::vector<unsigned char> pixels;	// RGBA, bottom row first
+	};
+
+	// maps the slot's finished read, copies it into a free frame and queues that
+	void retire(int slot)
+	{
+		// the read was issued PBOS - 1 frames ago, so this rarely waits
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync(fences[slot], flags, 1000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+		glDeleteSync(fences[slot]);
+		fences[slot] = 0;
+
+		std::unique_ptr<Frame> frame = acquireFrame();
+		frame->index = pending[slot];
+		frame->sequence = nextSequence++;
+		pending[slot] = -1;
+
+		const size_t frameBytes = (size_t)width * height * 4;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, PBO[slot]);
+		const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameBytes, GL_MAP_READ_BIT);
+		if (pixels)
+			memcpy(&frame->pixels[0], pixels, frameBytes);
+		else
+			memset(&frame->pixels[0], 0, frameBytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(std::move(frame));
+		queuedFrame.notify_one();
+	}
+
+	// a recycled frame, waiting while maxQueued frames are in the queue
+	std::unique_ptr<Frame> acquireFrame()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (queue.size() >= (size_t)maxQueued)
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			takenFrame.wait(lock, [this] { return queue.size() < (size_t)maxQueued; });
+			stats.stalls++;
+			stats.stallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		std::unique_ptr<Frame> frame;
+		if (!freeFrames.empty())
+		{
+			frame = std::move(freeFrames.back());
+			freeFrames.pop_back();
+		}
+		else
+		{
+			frame.reset(new Frame());
+			frame->pixels.resize((size_t)width * height * 4);
+		}
+		return frame;
+	}
+
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		queuedFrame.notify_all();
+		for (size_t i = 0; i < encoders.size(); i++)
+			encoders[i].join();
+		encoders.clear();
+		if (video)
+		{
+			if (fclose(video) != 0)
+				std::cout << "ERROR::FRAME_CAPTURE: failed to write " << path << std::endl;
+			video = NULL;
+		}
+	}
+
+	void encoderLoop()
+	{
+		// per-thread scratch for the encoded frame
+		std::vector<unsigned char> encoded;
+		while (true)
+		{
+			std::unique_ptr<Frame> frame;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				queuedFrame.wait(lock, [this] { return closed || !queue.empty(); });
+				if (queue.empty())
+					return;
+				frame = std::move(queue.front());
+				queue.pop_front();
+			}
+			takenFrame.notify_one();
+
+			bool ok = format == Y4M ? writeVideoFrame(*frame, encoded) : writeImage(*frame, encoded);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (ok)
+				stats.written++;
+			else
+				stats.failed++;
+			freeFrames.push_back(std::move(frame));
+		}
+	}
+
+	// binary PPM, top row first
+	bool writeImage(const Frame& frame, std::vector<unsigned char>& encoded) const
+	{
+		encoded.resize((size_t)width * height * 3);
+		unsigned char* out = &encoded[0];
+		for (int y = height - 1; y >= 0; y--)
+		{
+			const unsigned char* in = &frame.pixels[(size_t)y * width * 4];
+			for (int x = 0; x < width; x++, in += 4, out += 3)
+			{
+				out[0] = in[0];
+				out[1] = in[1];
+				out[2] = in[2];
+			}
+		}
+
+		char name[32];
+		snprintf(name, sizeof(name), "/frame_%05d.ppm", frame.index);
+		FILE* file = fopen((path + name).c_str(), "wb");
+		if (!file)
+			return false;
+		fprintf(file, "P6\n%d %d\n255\n", width, height);
+		bool ok = fwrite(&encoded[0], 1, encoded.size(), file) == encoded.size();
+		return (fclose(file) == 0) && ok;
+	}
+
+	// converts to planar 4:2:0 in parallel with the other encoders, then appends the
+	// frame once every frame captured before it was written
+	bool writeVideoFrame(const Frame& frame, std::vector<unsigned char>& encoded)
+	{
+		const size_t lumaBytes = (size_t)videoWidth * videoHeight;
+		const size_t chromaWidth = videoWidth / 2;
+		encoded.resize(lumaBytes + lumaBytes / 2);
+		unsigned char* luma = &encoded[0];
+		unsigned char* cb = luma + lumaBytes;
+		unsigned char* cr = cb + lumaBytes / 4;
+		for (int y = 0; y < videoHeight; y += 2)
+		{
+			// GL rows start at the bottom
+			const unsigned char* rows[2] = {
+				&frame.pixels[(size_t)(height - 1 - y) * width * 4],
+				&frame.pixels[(size_t)(height - 2 - y) * width * 4]
+			};
+			for (int x = 0; x < videoWidth; x += 2)
+			{
+				int r = 0, g = 0, b = 0;
+				for (int dy = 0; dy < 2; dy++)
+				{
+					for (int dx = 0; dx < 2; dx++)
+					{
+						const unsigned char* p = rows[dy] + (x + dx) * 4;
+						luma[(size_t)(y + dy) * videoWidth + x + dx] = (unsigned char)(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+						r += p[0];
+						g += p[1];
+						b += p[2];
+					}
+				}
+				// chroma of the 2x2 block's average color
+				r = (r + 2) / 4;
+				g = (g + 2) / 4;
+				b = (b + 2) / 4;
+				const size_t c = (size_t)(y / 2) * chromaWidth + x / 2;
+				cb[c] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+				cr[c] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+			}
+		}
+
+		// the frame before this one is held by another encoder, never still queued. only
+		// the encoder whose turn it is touches the file, so no lock is held while writing
+		{
+			std::unique_lock<std::mutex> lock(writeMutex);
+			written.wait(lock, [this, &frame] { return nextWrite == frame.sequence; });
+		}
+		bool ok = video && fwrite("FRAME\n", 1, 6, video) == 6 && fwrite(&encoded[0], 1, encoded.size(), video) == encoded.size();
+		{
+			std::lock_guard<std::mutex> lock(writeMutex);
+			nextWrite++;
+		}
+		written.notify_all();
+		return ok;
+	}
+
+	const int width, height;
+	const Format format;
+	const std::string path;
+	const int maxQueued;
+	int videoWidth, videoHeight;
+	FILE* video;
+
+	// GL side, only touched by the thread calling capture()
+	unsigned int PBO[PBOS];
+	GLsync fences[PBOS];
+	int pending[PBOS];		// frame index read into each PBO, -1 when free
+	int nextSlot;
+	int nextSequence;
+
+	// shared with the encoders
+	std::mutex mutex;
+	std::condition_variable queuedFrame;
+	std::condition_variable takenFrame;
+	std::deque<std::unique_ptr<Frame> > queue;
+	std::vector<std::unique_ptr<Frame> > freeFrames;
+	std::vector<std::thread> encoders;
+	bool closed;
+	Stats stats;
+
+	// orders the video writes among the encoders
+	std::mutex writeMutex;
+	std::condition_variable written;
+	int nextWrite;		// sequence of the frame to append next
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef FRAME_SNAPSHOT_H
+#define FRAME_SNAPSHOT_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "clusteredlights.h"
+#include "forest.h"
+#include "renderqueue.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// everything the renderer needs to draw one frame, written by the simulation and never
+// changed once published: the camera, the culled draw list and the moving parts of the
+// world. the renderer keeps no pointers into the simulation's own state
+struct FrameSnapshot
+{
+	int frameIndex;
+	float time;				// getTime() when the frame was simulated
+
+	// camera
+	glm::vec3 cameraPos;
+	glm::vec3 cameraFront;
+	glm::vec3 cameraUp;
+	float fov;
+	bool isOrtho;
+	int width;				// framebuffer size
+	int height;
+
+	// visible objects with their level of detail chosen, in no particular order
+	std::vector<Renderable> visible;
+
+	// animated state, copied whole each frame since any snapshot may be skipped
+	std::vector<PointLight> lights;
+	int treeVersion;		// changes whenever the tree transforms did
+	std::vector<glm::mat4> trunkInstances;
+	std::vector<glm::mat4> leafInstances;
+	std::vector<AABB> trunkBounds;
+	int forestVersion;		// Forest::getVersion() the cells belong to
+	std::vector<Forest::Visible> forestCells;
+
+	FrameSnapshot()
+		: frameIndex(0), time(0.0f), fov(45.0f), isOrtho(false), width(0), height(0), treeVersion(0), forestVersion(0)
+	{
+	}
+};
+
+// triple buffered mailbox between one producer and one consumer. the producer fills
+// back() and publishes it, the consumer draws from the slot acquire() hands out, and the
+// third slot holds the newest published snapshot in between. neither side ever waits
+// for the other to finish a frame: publishing replaces a snapshot the consumer has not
+// taken yet, so the consumer always gets the latest one and the producer never stalls
+template <typename T>
+class SnapshotMailbox
+{
+public:
+	SnapshotMailbox()
+		: backSlot(0), readySlot(1), frontSlot(2), fresh(false), closed(false)
+	{
+	}
+
+	SnapshotMailbox(const SnapshotMailbox&) = delete;
+	SnapshotMailbox& operator=(const SnapshotMailbox&) = delete;
+
+	// the slot the producer fills next; owned by the producer until publish()
+	// ------------------------------------------------------------------------
+	T& back()
+	{
+		return slots[backSlot];
+	}
+
+	// hands the back slot over as the newest snapshot
+	// ------------------------------------------------------------------------
+	void publish()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::swap(backSlot, readySlot);
+			fresh = true;
+		}
+		published.notify_one();
+	}
+
+	// waits for a snapshot newer than the last one taken and returns it; it stays valid
+	// until the next acquire(). returns NULL once the mailbox is closed
+	// ------------------------------------------------------------------------
+	const T* acquire()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		published.wait(lock, [this] { return fresh || closed; });
+		if (!fresh)
+			return NULL;
+		std::swap(frontSlot, readySlot);
+		fresh = false;
+		return &slots[frontSlot];
+	}
+
+	// wakes the consumer for good
+	// ------------------------------------------------------------------------
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		published.notify_one();
+	}
+
+private:
+	T slots[3];
+	int backSlot, readySlot, frontSlot;
+	bool fresh;
+	bool closed;
+	std::mutex mutex;
+	std::condition_variable published;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef FRAME_TIME_STATS_H
+#define FRAME_TIME_STATS_H
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// collects every frame time of a run and summarizes them; percentiles expose the
+// hitches an average hides
+class FrameTimeStats
+{
+public:
+	void add(float seconds)
+	{
+		samples.push_back(seconds);
+	}
+
+	size_t size() const
+	{
+		return samples.size();
+	}
+
+	void clear()
+	{
+		samples.clear();
+	}
+
+	// nearest-rank percentile in seconds, p in [0, 100]
+	// ------------------------------------------------------------------------
+	float percentile(float p) const
+	{
+		if (samples.empty())
+			return 0.0f;
+		std::vector<float> sorted(samples);
+		size_t rank = (size_t)(p / 100.0f * sorted.size() + 0.999f);
+		rank = std::min(std::max(rank, (size_t)1), sorted.size());
+		std::nth_element(sorted.begin(), sorted.begin() + (rank - 1), sorted.end());
+		return sorted[rank - 1];
+	}
+
+	float average() const
+	{
+		if (samples.empty())
+			return 0.0f;
+		double total = 0.0;
+		for (size_t i = 0; i < samples.size(); i++)
+			total += samples[i];
+		return (float)(total / samples.size());
+	}
+
+	// prints min/avg/p95/p99/max in milliseconds
+	// ------------------------------------------------------------------------
+	void report(std::ostream& out) const
+	{
+		if (samples.empty())
+		{
+			out << "no frames measured" << std::endl;
+			return;
+		}
+		out << samples.size() << " frames: min " << 1000.0f * *std::min_element(samples.begin(), samples.end())
+			<< " ms, avg " << 1000.0f * average()
+			<< " ms, p95 " << 1000.0f * percentile(95.0f)
+			<< " ms, p99 " << 1000.0f * percentile(99.0f)
+			<< " ms, max " << 1000.0f * *std::max_element(samples.begin(), samples.end()) << " ms" << std::endl;
+	}
+
+private:
+	std::vector<float> samples;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// the project builds against a GL 3.3 core glad. the optional paths that need later entry
+// points load them here at runtime, through the same loader glad was given, so they work
+// on every driver that has them without regenerating glad. call loadGLExtensions() right
+// after gladLoadGLLoader(); a path may only be used while its flag is set
+
+// enums of those paths that a 3.3 glad does not define
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+struct GLExtensions
+{
+	typedef void (APIENTRYP DispatchComputeProc)(GLuint numGroupsX, GLuint numGroupsY, GLuint numGroupsZ);
+	typedef void (APIENTRYP MemoryBarrierProc)(GLbitfield barriers);
+	typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+	typedef void (APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+	typedef void (APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+	typedef void (APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+	typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+	// version of the current context
+	GLint major;
+	GLint minor;
+
+	// OpenGL 4.3: compute shaders, shader storage buffers and multi draw indirect. the
+	// shaders of this path are GLSL 4.30, so the extensions on an older context don't count
+	bool gpuDriven;
+	DispatchComputeProc dispatchCompute;
+	MemoryBarrierProc memoryBarrier;
+	MultiDrawElementsIndirectProc multiDrawElementsIndirect;
+
+	// OpenGL 4.1 or ARB_get_program_binary, with at least one binary format: some drivers
+	// have the entry points but nothing to store
+	bool programBinaries;
+	GetProgramBinaryProc getProgramBinary;
+	ProgramBinaryProc programBinary;
+	ProgramParameteriProc programParameteri;
+
+	// OpenGL 4.4 or ARB_buffer_storage (Mesa has it on 3.3 contexts too): immutable
+	// buffers that stay mapped while the GPU reads them
+	bool persistentBuffers;
+	BufferStorageProc bufferStorage;
+
+	bool atLeast(int wantMajor, int wantMinor) const
+	{
+		return major > wantMajor || (major == wantMajor && minor >= wantMinor);
+	}
+};
+
+// the entry points of the current context, all unset until loadGLExtensions()
+inline GLExtensions& glExtensions()
+{
+	static GLExtensions extensions = GLExtensions();
+	return extensions;
+}
+
+// true if the current context lists the extension
+// ------------------------------------------------------------------------
+inline bool hasGLExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const GLubyte* extension = glGetStringi(GL_EXTENSIONS, (GLuint)i);
+		if (extension && strcmp((const char*)extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+// resolves the entry points through load (the function passed to gladLoadGLLoader) and
+// sets the flag of every path the current context supports
+// ------------------------------------------------------------------------
+inline void loadGLExtensions(GLADloadproc load)
+{
+	GLExtensions& gl = glExtensions();
+	gl = GLExtensions();
+	glGetIntegerv(GL_MAJOR_VERSION, &gl.major);
+	glGetIntegerv(GL_MINOR_VERSION, &gl.minor);
+
+	if (gl.atLeast(4, 3))
+	{
+		gl.dispatchCompute = (GLExtensions::DispatchComputeProc)load("glDispatchCompute");
+		gl.memoryBarrier = (GLExtensions::MemoryBarrierProc)load("glMemoryBarrier");
+		gl.multiDrawElementsIndirect = (GLExtensions::MultiDrawElementsIndirectProc)load("glMultiDrawElementsIndirect");
+		gl.gpuDriven = gl.dispatchCompute && gl.memoryBarrier && gl.multiDrawElementsIndirect;
+	}
+
+	if (gl.atLeast(4, 1) || hasGLExtension("GL_ARB_get_program_binary"))
+	{
+		gl.getProgramBinary = (GLExtensions::GetProgramBinaryProc)load("glGetProgramBinary");
+		gl.programBinary = (GLExtensions::ProgramBinaryProc)load("glProgramBinary");
+		gl.programParameteri = (GLExtensions::ProgramParameteriProc)load("glProgramParameteri");
+		GLint formats = 0;
+		if (gl.getProgramBinary && gl.programBinary && gl.programParameteri)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		gl.programBinaries = formats > 0;
+	}
+
+	if (gl.atLeast(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+	{
+		gl.bufferStorage = (GLExtensions::BufferStorageProc)load("glBufferStorage");
+		gl.persistentBuffers = gl.bufferStorage != NULL;
+	}
+}
+
+#endif
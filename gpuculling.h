@@ -0,0 +1,240 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "glextensions.h"
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// GPU driven drawing of objects that share one indexed vertex array: their transforms,
+// bounds and index ranges live in a shader storage buffer, a compute shader (gpu_cull.cs)
+// tests every object against the view frustum and writes one DrawElementsIndirectCommand
+// per object, and a single glMultiDrawElementsIndirect then draws them all. the CPU cost
+// per frame is one dispatch and one draw no matter how many objects there are.
+//
+// needs OpenGL 4.3 (compute shaders, storage buffers, multi draw indirect), which Mesa's
+// llvmpipe provides in software. the vertex shader (7.5.gpu_driven.vs) finds its object
+// through an instanced attribute that the base instance of each command points at. the
+// 4.3 entry points come from glextensions.h, so a 3.3 glad is enough to build it
+class GpuCuller
+{
+public:
+	static const unsigned int OBJECT_ID_ATTRIB = 8;
+	static const unsigned int OBJECT_BINDING = 0;
+	static const unsigned int COMMAND_BINDING = 1;
+	static const int WORKGROUP_SIZE = 64;
+
+	// matches struct Object in the shaders (std430)
+	struct Object
+	{
+		glm::mat4 model;
+		glm::vec4 boundsMin;
+		glm::vec4 boundsMax;
+		float layer;
+		uint32_t indexCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+	};
+
+	static_assert(sizeof(Object) == 112, "GpuCuller::Object must match the std430 layout");
+
+	GpuCuller()
+		: VAO(0), VBO(0), EBO(0), idVBO(0), objectSSBO(0), commandBuffer(0), cullProgram(0), planesLocation(-1), countLocation(-1)
+	{
+	}
+
+	GpuCuller(const GpuCuller&) = delete;
+	GpuCuller& operator=(const GpuCuller&) = delete;
+
+	static bool isSupported()
+	{
+		return glExtensions().gpuDriven;
+	}
+
+	// adds an object drawing indices [firstIndex, firstIndex + indexCount) of the shared
+	// geometry; call before create()
+	// ------------------------------------------------------------------------
+	int add(const glm::mat4& model, const AABB& localBounds, float layer, uint32_t firstIndex, uint32_t indexCount, int32_t baseVertex)
+	{
+		Object object;
+		object.model = model;
+		AABB bounds = localBounds.transformed(model);
+		object.boundsMin = glm::vec4(bounds.min, 1.0f);
+		object.boundsMax = glm::vec4(bounds.max, 1.0f);
+		object.layer = layer;
+		object.indexCount = indexCount;
+		object.firstIndex = firstIndex;
+		object.baseVertex = baseVertex;
+		objects.push_back(object);
+		return (int)objects.size() - 1;
+	}
+
+	// uploads the shared position/texcoord vertices, 16-bit indices and the object table,
+	// and builds the culling program
+	// ------------------------------------------------------------------------
+	bool create(const float* vertices, int vertexCount, const uint16_t* indices, int indexCount, const char* computePath)
+	{
+		if (!isSupported())
+			return false;
+		cullProgram = compileCompute(computePath);
+		if (!cullProgram)
+			return false;
+		planesLocation = glGetUniformLocation(cullProgram, "planes");
+		countLocation = glGetUniformLocation(cullProgram, "objectCount");
+
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+		glGenBuffers(1, &idVBO);
+		glGenBuffers(1, &objectSSBO);
+		glGenBuffers(1, &commandBuffer);
+
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexCount * 5 * sizeof(float), vertices, GL_STATIC_DRAW);
+		// position attribute
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		// texture coord attribute
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)indexCount * sizeof(uint16_t), indices, GL_STATIC_DRAW);
+
+		// object index per instance; instance 0 of command i reads entry i (its base instance)
+		std::vector<uint32_t> ids(objects.size());
+		for (size_t i = 0; i < ids.size(); i++)
+			ids[i] = (uint32_t)i;
+		glBindBuffer(GL_ARRAY_BUFFER, idVBO);
+		glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(uint32_t), ids.empty() ? NULL : &ids[0], GL_STATIC_DRAW);
+		glVertexAttribIPointer(OBJECT_ID_ATTRIB, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)0);
+		glEnableVertexAttribArray(OBJECT_ID_ATTRIB);
+		glVertexAttribDivisor(OBJECT_ID_ATTRIB, 1);
+		glBindVertexArray(0);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(Object), objects.empty() ? NULL : &objects[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * 5 * sizeof(uint32_t), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return true;
+	}
+
+	// moves an object; only its entry of the object table is re-uploaded
+	// ------------------------------------------------------------------------
+	void setTransform(int object, const glm::mat4& model, const AABB& localBounds)
+	{
+		Object& o = objects[object];
+		o.model = model;
+		AABB bounds = localBounds.transformed(model);
+		o.boundsMin = glm::vec4(bounds.min, 1.0f);
+		o.boundsMax = glm::vec4(bounds.max, 1.0f);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectSSBO);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, object * sizeof(Object), sizeof(Object), &o);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	// writes this frame's draw commands on the GPU
+	// ------------------------------------------------------------------------
+	void cull(const Frustum& frustum)
+	{
+		if (objects.empty())
+			return;
+		glUseProgram(cullProgram);
+		glUniform4fv(planesLocation, 6, &frustum.planes[0].x);
+		glUniform1ui(countLocation, (GLuint)objects.size());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_BINDING, objectSSBO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, commandBuffer);
+		glExtensions().dispatchCompute((GLuint)(objects.size() + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+		glExtensions().memoryBarrier(GL_COMMAND_BARRIER_BIT);
+	}
+
+	// draws every object with one call; the drawing program must be bound
+	// ------------------------------------------------------------------------
+	void render() const
+	{
+		if (objects.empty())
+			return;
+		glBindVertexArray(VAO);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_BINDING, objectSSBO);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glExtensions().multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)0, (GLsizei)objects.size(), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	int getObjectCount() const
+	{
+		return (int)objects.size();
+	}
+
+	void deleteBuffers()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		glDeleteBuffers(1, &idVBO);
+		glDeleteBuffers(1, &objectSSBO);
+		glDeleteBuffers(1, &commandBuffer);
+		glDeleteProgram(cullProgram);
+		VAO = VBO = EBO = idVBO = objectSSBO = commandBuffer = cullProgram = 0;
+	}
+
+private:
+	// the Shader class only builds vertex/fragment programs
+	static unsigned int compileCompute(const char* path)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			std::cout << "Failed to open compute shader: " << path << std::endl;
+			return 0;
+		}
+		std::stringstream stream;
+		stream << file.rdbuf();
+		std::string source = stream.str();
+		const char* code = source.c_str();
+
+		int success;
+		char infoLog[1024];
+		unsigned int shader = glCreateShader(GL_COMPUTE_SHADER);
+		glShaderSource(shader, 1, &code, NULL);
+		glCompileShader(shader);
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+			std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: COMPUTE\n" << infoLog << std::endl;
+			glDeleteShader(shader);
+			return 0;
+		}
+		unsigned int program = glCreateProgram();
+		glAttachShader(program, shader);
+		glLinkProgram(program);
+		glDeleteShader(shader);
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramInfoLog(program, 1024, NULL, infoLog);
+			std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: COMPUTE\n" << infoLog << std::endl;
+			glDeleteProgram(program);
+			return 0;
+		}
+		return program;
+	}
+
+	std::vector<Object> objects;
+	unsigned int VAO, VBO, EBO, idVBO;
+	unsigned int objectSSBO, commandBuffer;
+	unsigned int cullProgram;
+	int planesLocation, countLocation;
+};
+
+#endif
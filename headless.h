@@ -0,0 +1,251 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "glextensions.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#ifdef __linux__
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+// OpenGL context without a window or display, for render farm nodes and CI. uses EGL on
+// Mesa's surfaceless platform, which runs on llvmpipe when there is no GPU (set
+// LIBGL_ALWAYS_SOFTWARE=1 to force it). only available on Linux (link with -lEGL)
+class HeadlessContext
+{
+public:
+	HeadlessContext()
+#ifdef __linux__
+		: display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT)
+#endif
+	{
+	}
+
+	~HeadlessContext()
+	{
+		destroy();
+	}
+
+	HeadlessContext(const HeadlessContext&) = delete;
+	HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+	// creates a core profile context of the given version, makes it current and loads GL
+	// ------------------------------------------------------------------------
+	bool create(int major, int minor)
+	{
+#ifdef __linux__
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay)
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY)
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		EGLint eglMajor, eglMinor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &eglMajor, &eglMinor))
+		{
+			std::cout << "Failed to initialize EGL" << std::endl;
+			return false;
+		}
+		if (!eglBindAPI(EGL_OPENGL_API))
+		{
+			std::cout << "EGL does not support desktop OpenGL" << std::endl;
+			return false;
+		}
+
+		// no surface is ever created, everything renders into framebuffer objects
+		const EGLint configAttributes[] = {
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint numConfigs = 0;
+		if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0)
+		{
+			std::cout << "Failed to find an EGL config" << std::endl;
+			return false;
+		}
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, major,
+			EGL_CONTEXT_MINOR_VERSION, minor,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		{
+			std::cout << "Failed to create a surfaceless OpenGL " << major << "." << minor << " context" << std::endl;
+			return false;
+		}
+		if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return false;
+		}
+		loadGLExtensions((GLADloadproc)eglGetProcAddress);
+		return true;
+#else
+		std::cout << "Headless mode needs EGL and is only available on Linux" << std::endl;
+		return false;
+#endif
+	}
+
+	void destroy()
+	{
+#ifdef __linux__
+		if (display != EGL_NO_DISPLAY)
+		{
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (context != EGL_NO_CONTEXT)
+				eglDestroyContext(display, context);
+			eglTerminate(display);
+		}
+		display = EGL_NO_DISPLAY;
+		context = EGL_NO_CONTEXT;
+#endif
+	}
+
+private:
+#ifdef __linux__
+	EGLDisplay display;
+	EGLContext context;
+#endif
+};
+
+// framebuffer object with color and depth renderbuffers that stands in for the window
+class OffscreenTarget
+{
+public:
+	OffscreenTarget(int width, int height)
+		: width(width), height(height)
+	{
+		glGenFramebuffers(1, &FBO);
+		glGenRenderbuffers(1, &colorRBO);
+		glGenRenderbuffers(1, &depthRBO);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Offscreen framebuffer is not complete" << std::endl;
+		glViewport(0, 0, width, height);
+	}
+
+	OffscreenTarget(const OffscreenTarget&) = delete;
+	OffscreenTarget& operator=(const OffscreenTarget&) = delete;
+
+	// makes the target the default for rendering again (other passes may rebind)
+	// ------------------------------------------------------------------------
+	void bind() const
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+	}
+
+	void deleteBuffers()
+	{
+		glDeleteFramebuffers(1, &FBO);
+		glDeleteRenderbuffers(1, &colorRBO);
+		glDeleteRenderbuffers(1, &depthRBO);
+		FBO = colorRBO = depthRBO = 0;
+	}
+
+	unsigned int FBO;
+	const int width, height;
+
+private:
+	unsigned int colorRBO, depthRBO;
+};
+
+// scripted camera for headless runs, a text file with one keyframe per line:
+//	frame  posX posY posZ  frontX frontY frontZ  fov
+// lines starting with # are ignored; frames between keyframes are interpolated
+class CameraPath
+{
+public:
+	struct Key
+	{
+		int frame;
+		glm::vec3 position;
+		glm::vec3 front;
+		float fov;
+	};
+
+	bool load(const std::string& path)
+	{
+		std::ifstream file(path.c_str());
+		if (!file)
+		{
+			std::cout << "Failed to open camera path: " << path << std::endl;
+			return false;
+		}
+		keys.clear();
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (line.empty() || line[0] == '#')
+				continue;
+			std::istringstream in(line);
+			Key key;
+			if (in >> key.frame >> key.position.x >> key.position.y >> key.position.z >> key.front.x >> key.front.y >> key.front.z >> key.fov)
+				keys.push_back(key);
+		}
+		return !keys.empty();
+	}
+
+	bool isEmpty() const
+	{
+		return keys.empty();
+	}
+
+	// camera state at frame, holding the first and last keys beyond the path's ends
+	// ------------------------------------------------------------------------
+	void sample(int frame, glm::vec3& position, glm::vec3& front, float& fov) const
+	{
+		if (keys.empty())
+			return;
+		size_t next = 0;
+		while (next < keys.size() && keys[next].frame <= frame)
+			next++;
+		const Key& a = keys[next == 0 ? 0 : next - 1];
+		const Key& b = keys[next == keys.size() ? keys.size() - 1 : next];
+		float t = b.frame > a.frame ? (float)(frame - a.frame) / (b.frame - a.frame) : 0.0f;
+		t = glm::clamp(t, 0.0f, 1.0f);
+		position = a.position + (b.position - a.position) * t;
+		front = glm::normalize(a.front + (b.front - a.front) * t);
+		fov = a.fov + (b.fov - a.fov) * t;
+	}
+
+private:
+	std::vector<Key> keys;
+};
+
+inline void ensureOutputDirectory(const std::string& directory)
+{
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+}
+
+#endif
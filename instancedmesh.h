@@ -0,0 +1,149 @@
+#ifndef INSTANCED_MESH_H
+#define INSTANCED_MESH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// a mesh in the interleaved position/texcoord layout plus buffers of per-instance model
+// matrices and texture array layers, so every copy of the mesh is drawn with a single
+// glDrawArraysInstanced call, or glDrawElementsInstanced when it has 16-bit indices.
+// the per-instance matrix occupies attribute locations 3-6 and the layer location 7
+// (see 7.4.camera_array_instanced.vs)
+class InstancedMesh
+{
+public:
+	static const unsigned int INSTANCE_ATTRIB = 3;
+	static const unsigned int LAYER_ATTRIB = 7;
+
+	InstancedMesh(const float* vertices, int numVertices)
+		: EBO(0), vertexCount(numVertices), indexCount(0), instanceCount(0), instanceCapacity(0)
+	{
+		createBuffers(vertices, numVertices);
+	}
+
+	InstancedMesh(const float* vertices, int numVertices, const uint16_t* indices, int numIndices)
+		: EBO(0), vertexCount(numVertices), indexCount(numIndices), instanceCount(0), instanceCapacity(0)
+	{
+		createBuffers(vertices, numVertices);
+		glBindVertexArray(VAO);
+		glGenBuffers(1, &EBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(uint16_t), indices, GL_STATIC_DRAW);
+		glBindVertexArray(0);
+	}
+
+	InstancedMesh(const std::vector<float>& vertices, const std::vector<uint16_t>& indices)
+		: InstancedMesh(&vertices[0], (int)vertices.size() / 5, &indices[0], (int)indices.size())
+	{
+	}
+
+	InstancedMesh(const InstancedMesh&) = delete;
+	InstancedMesh& operator=(const InstancedMesh&) = delete;
+
+	// uploads the instance transforms and texture layers; only reallocates the buffers
+	// when they have to grow
+	// ------------------------------------------------------------------------
+	void setInstances(const glm::mat4* transforms, const float* layers, int count)
+	{
+		bool grow = count > instanceCapacity;
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		if (grow)
+			glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), transforms, GL_STATIC_DRAW);
+		else if (count > 0)
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), transforms);
+
+		glBindBuffer(GL_ARRAY_BUFFER, layerVBO);
+		if (grow)
+			glBufferData(GL_ARRAY_BUFFER, count * sizeof(float), layers, GL_STATIC_DRAW);
+		else if (count > 0)
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(float), layers);
+
+		if (grow)
+			instanceCapacity = count;
+		instanceCount = count;
+	}
+
+	void setInstances(const std::vector<glm::mat4>& transforms, const std::vector<float>& layers)
+	{
+		setInstances(transforms.empty() ? NULL : &transforms[0], layers.empty() ? NULL : &layers[0], (int)transforms.size());
+	}
+
+	// draws every instance with one call
+	// ------------------------------------------------------------------------
+	void render() const
+	{
+		if (instanceCount == 0)
+			return;
+		glBindVertexArray(VAO);
+		if (indexCount > 0)
+			glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, (void*)0, instanceCount);
+		else
+			glDrawArraysInstanced(GL_TRIANGLES, 0, vertexCount, instanceCount);
+	}
+
+	int getInstanceCount() const
+	{
+		return instanceCount;
+	}
+
+	// frees the GPU buffers; needs a current GL context
+	// ------------------------------------------------------------------------
+	void deleteMesh()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &instanceVBO);
+		glDeleteBuffers(1, &layerVBO);
+		if (EBO)
+			glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = instanceVBO = layerVBO = 0;
+		instanceCount = instanceCapacity = 0;
+	}
+
+private:
+	void createBuffers(const float* vertices, int numVertices)
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &instanceVBO);
+		glGenBuffers(1, &layerVBO);
+
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, numVertices * 5 * sizeof(float), vertices, GL_STATIC_DRAW);
+
+		// position attribute
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		// texture coord attribute
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+
+		// instance model matrix, one vec4 column per attribute, advanced once per instance
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			glVertexAttribPointer(INSTANCE_ATTRIB + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+			glEnableVertexAttribArray(INSTANCE_ATTRIB + i);
+			glVertexAttribDivisor(INSTANCE_ATTRIB + i, 1);
+		}
+
+		// instance texture layer
+		glBindBuffer(GL_ARRAY_BUFFER, layerVBO);
+		glVertexAttribPointer(LAYER_ATTRIB, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
+		glEnableVertexAttribArray(LAYER_ATTRIB);
+		glVertexAttribDivisor(LAYER_ATTRIB, 1);
+		glBindVertexArray(0);
+	}
+
+	unsigned int VAO, VBO, EBO, instanceVBO, layerVBO;
+	int vertexCount;
+	int indexCount;
+	int instanceCount;
+	int instanceCapacity;
+};
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// counts the unfinished jobs started with it; a frame declares one per batch of work it
+// has to wait for and passes it to JobSystem::wait() before using the results
+class JobCounter
+{
+public:
+	JobCounter()
+		: pending(0)
+	{
+	}
+
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool done() const
+	{
+		return pending.load(std::memory_order_acquire) == 0;
+	}
+
+private:
+	friend class JobSystem;
+	std::atomic<int> pending;
+};
+
+// a work-stealing scheduler for the frame's CPU work. every thread that runs jobs owns a
+// slot with a deque: it pushes and pops its own jobs at the back, and idle threads steal
+// from the front of the others, where the oldest and so largest pieces of a recursively
+// split range sit. the pool has numThreads workers; threads outside it (the main and
+// render threads) get one of EXTERNAL_SLOTS slots on first use and run jobs while they
+// wait, so a pool of zero workers simply runs everything on the caller. a thread hands
+// its slot back when it exits; any further outside thread waits until one is free.
+//
+// the deques are short and only contended while stealing, so each is a plain mutex
+// guarded std::deque rather than a lock-free one
+class JobSystem
+{
+public:
+	static const int EXTERNAL_SLOTS = 4;
+
+	// numThreads < 0 starts one worker per core besides the calling thread
+	explicit JobSystem(int numThreads = -1)
+		: externals(std::make_shared<ExternalSlots>()), queued(0), sleepers(0), stopping(false)
+	{
+		externals->used.assign(EXTERNAL_SLOTS, false);
+		if (numThreads < 0)
+			numThreads = (int)std::thread::hardware_concurrency() - 1;
+		numThreads = std::max(numThreads, 0);
+		for (int i = 0; i < numThreads + EXTERNAL_SLOTS; i++)
+			queues.push_back(std::unique_ptr<Queue>(new Queue()));
+		for (int i = 0; i < numThreads; i++)
+			workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	int workerCount() const
+	{
+		return (int)workers.size();
+	}
+
+	// number of slots; per-thread scratch data indexed by slot() needs this many entries
+	int slotCount() const
+	{
+		return (int)queues.size();
+	}
+
+	// the calling thread's slot, registering a thread from outside the pool on first use
+	// ------------------------------------------------------------------------
+	int slot()
+	{
+		ThreadSlot& current = threadSlot();
+		if (current.system.owner_before(externals) || externals.owner_before(current.system))
+		{
+			current.release();
+			std::unique_lock<std::mutex> lock(externals->mutex);
+			int external = -1;
+			externals->released.wait(lock, [this, &external]
+			{
+				external = (int)(std::find(externals->used.begin(), externals->used.end(), false) - externals->used.begin());
+				return external < EXTERNAL_SLOTS;
+			});
+			externals->used[external] = true;
+			current.system = externals;
+			current.external = external;
+			current.index = workerCount() + external;
+		}
+		return current.index;
+	}
+
+	// queues job on the calling thread's deque; counter stays pending until it has run
+	// ------------------------------------------------------------------------
+	void run(JobCounter& counter, std::function<void()> job)
+	{
+		counter.pending.fetch_add(1, std::memory_order_relaxed);
+		Queue& queue = *queues[slot()];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(Job(std::move(job), &counter));
+		}
+		queued.fetch_add(1);
+		if (sleepers.load() > 0)
+		{
+			// taking the lock orders this wake-up after a worker's last look at queued
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			wake.notify_one();
+		}
+	}
+
+	// runs queued jobs, its own first, until every job of counter has finished
+	// ------------------------------------------------------------------------
+	void wait(JobCounter& counter)
+	{
+		const int self = slot();
+		while (!counter.done())
+		{
+			if (!runOne(self))
+				std::this_thread::yield();
+		}
+	}
+
+	// calls body(first, last) over [begin, end) in ranges of at most grain elements and
+	// returns once all have run. the range is halved recursively, so idle threads steal
+	// large pieces, and every piece starts at begin plus a multiple of grain: output kept
+	// per piece (index (first - begin) / grain) merges in the same order as a serial loop
+	// ------------------------------------------------------------------------
+	void parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body)
+	{
+		if (begin >= end)
+			return;
+		grain = std::max<size_t>(grain, 1);
+		JobCounter counter;
+		split(begin, end, grain, body, counter);
+		wait(counter);
+	}
+
+private:
+	struct Job
+	{
+		std::function<void()> function;
+		JobCounter* counter;
+
+		Job(std::function<void()> function, JobCounter* counter)
+			: function(std::move(function)), counter(counter)
+		{
+		}
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	// which of the external slots are taken; shared with the threads holding them, so
+	// one exiting after the job system is gone has nothing left to hand back
+	struct ExternalSlots
+	{
+		std::mutex mutex;
+		std::condition_variable released;
+		std::vector<bool> used;
+	};
+
+	struct ThreadSlot
+	{
+		std::weak_ptr<ExternalSlots> system;	// identifies the job system
+		int index;
+		int external;	// -1 for workers
+
+		ThreadSlot()
+			: index(-1), external(-1)
+		{
+		}
+
+		~ThreadSlot()
+		{
+			release();
+		}
+
+		void release()
+		{
+			std::shared_ptr<ExternalSlots> slots = system.lock();
+			if (slots && external >= 0)
+			{
+				{
+					std::lock_guard<std::mutex> lock(slots->mutex);
+					slots->used[external] = false;
+				}
+				slots->released.notify_one();
+			}
+			system.reset();
+			index = external = -1;
+		}
+	};
+
+	static ThreadSlot& threadSlot()
+	{
+		static thread_local ThreadSlot current;
+		return current;
+	}
+
+	// hands the upper half of the range to the deque until a piece fits in grain
+	void split(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& body, JobCounter& counter)
+	{
+		while (end - begin > grain)
+		{
+			const size_t pieces = (end - begin + grain - 1) / grain;
+			const size_t middle = begin + pieces / 2 * grain;
+			const size_t last = end;
+			run(counter, [this, middle, last, grain, &body, &counter]() { split(middle, last, grain, body, counter); });
+			end = middle;
+		}
+		body(begin, end);
+	}
+
+	// pops from the back of the own deque or steals from the front of another one
+	bool runOne(int self)
+	{
+		std::function<void()> function;
+		JobCounter* counter = NULL;
+		{
+			Queue& own = *queues[self];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.jobs.empty())
+			{
+				function = std::move(own.jobs.back().function);
+				counter = own.jobs.back().counter;
+				own.jobs.pop_back();
+			}
+		}
+		for (int i = 1; !counter && i < slotCount(); i++)
+		{
+			Queue& victim = *queues[(self + i) % slotCount()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.jobs.empty())
+			{
+				function = std::move(victim.jobs.front().function);
+				counter = victim.jobs.front().counter;
+				victim.jobs.pop_front();
+			}
+		}
+		if (!counter)
+			return false;
+		queued.fetch_sub(1);
+		function();
+		counter->pending.fetch_sub(1, std::memory_order_release);
+		return true;
+	}
+
+	void workerLoop(int index)
+	{
+		threadSlot().system = externals;
+		threadSlot().index = index;
+		while (true)
+		{
+			if (runOne(index))
+				continue;
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			sleepers.fetch_add(1);
+			wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+			sleepers.fetch_sub(1);
+			if (stopping)
+				return;
+		}
+	}
+
+	std::shared_ptr<ExternalSlots> externals;
+	std::vector<std::unique_ptr<Queue> > queues;	// workers first, then the external slots
+	std::vector<std::thread> workers;
+	std::atomic<int> queued;	// jobs in all deques
+	std::atomic<int> sleepers;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	bool stopping;
+};
+
+#endif
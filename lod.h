@@ -0,0 +1,134 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "instancedmesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// approximate height in pixels of a box's bounding sphere on screen; works for both
+// perspective and orthographic projections
+// ------------------------------------------------------------------------
+inline float projectedSize(const AABB& bounds, const glm::vec3& eye, const glm::mat4& projection, int viewportHeight)
+{
+	float radius = glm::length(bounds.extents());
+	float scale = std::fabs(projection[1][1]) * radius * viewportHeight;
+	if (projection[3][3] != 0.0f)
+		return scale; // orthographic, size does not depend on distance
+	float distance = glm::length(bounds.center() - eye);
+	if (distance <= radius)
+		return 1e30f; // camera is inside the sphere
+	return scale / distance;
+}
+
+// chooses a level of detail (0 = finest) from projected size. level i is used while the
+// object is at least minSizes[i] pixels tall; switching only happens once the size is a
+// hysteresis fraction past the threshold, so objects near it do not pop back and forth
+class LodSelector
+{
+public:
+	LodSelector(const std::vector<float>& minSizes, float hysteresis = 0.15f)
+		: minSizes(minSizes), hysteresis(hysteresis)
+	{
+	}
+
+	int levelCount() const
+	{
+		return (int)minSizes.size() + 1;
+	}
+
+	// next level for an object currently drawn at level current
+	// ------------------------------------------------------------------------
+	int select(int current, float size) const
+	{
+		current = std::max(0, std::min(current, levelCount() - 1));
+		while (current > 0 && size >= minSizes[current - 1] * (1.0f + hysteresis))
+			current--;
+		while (current < levelCount() - 1 && size < minSizes[current] * (1.0f - hysteresis))
+			current++;
+		return current;
+	}
+
+private:
+	std::vector<float> minSizes;
+	float hysteresis;
+};
+
+// per-instance level of detail for an instanced mesh that exists at several resolutions.
+// every instance keeps its level between frames, and the instance buffers of the level
+// meshes are only regrouped and uploaded when some instance actually changed level
+class InstancedLod
+{
+public:
+	InstancedLod(const LodSelector& selector, const std::vector<InstancedMesh*>& levels)
+		: selector(selector), levels(levels)
+	{
+	}
+
+	// replaces the instance set; bounds are the world space bounds of each instance
+	// ------------------------------------------------------------------------
+	void setInstances(const std::vector<glm::mat4>& newTransforms, const std::vector<float>& newLayers, const std::vector<AABB>& newBounds)
+	{
+		transforms = newTransforms;
+		layers = newLayers;
+		bounds = newBounds;
+		current.assign(transforms.size(), selector.levelCount() - 1);
+		upload();
+	}
+
+	// moves the instances without resetting their levels, e.g. for animated transforms
+	// ------------------------------------------------------------------------
+	void setTransforms(const std::vector<glm::mat4>& newTransforms, const std::vector<AABB>& newBounds)
+	{
+		transforms = newTransforms;
+		bounds = newBounds;
+		upload();
+	}
+
+	// reselects every instance's level, returns true if the buffers were re-uploaded
+	// ------------------------------------------------------------------------
+	bool update(const glm::vec3& eye, const glm::mat4& projection, int viewportHeight)
+	{
+		bool changed = false;
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			int level = selector.select(current[i], projectedSize(bounds[i], eye, projection, viewportHeight));
+			if (level != current[i])
+			{
+				current[i] = level;
+				changed = true;
+			}
+		}
+		if (changed)
+			upload();
+		return changed;
+	}
+
+private:
+	void upload()
+	{
+		std::vector<std::vector<glm::mat4> > levelTransforms(levels.size());
+		std::vector<std::vector<float> > levelLayers(levels.size());
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			int level = std::min(current[i], (int)levels.size() - 1);
+			levelTransforms[level].push_back(transforms[i]);
+			levelLayers[level].push_back(layers[i]);
+		}
+		for (size_t level = 0; level < levels.size(); level++)
+			levels[level]->setInstances(levelTransforms[level], levelLayers[level]);
+	}
+
+	LodSelector selector;
+	std::vector<InstancedMesh*> levels;
+	std::vector<glm::mat4> transforms;
+	std::vector<float> layers;
+	std::vector<AABB> bounds;
+	std::vector<int> current;
+};
+
+#endif
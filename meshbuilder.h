@@ -0,0 +1,232 @@
+#ifndef MESH_BUILDER_H
+#define MESH_BUILDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// turns an expanded triangle list (every corner stored in full, as drawn by glDrawArrays)
+// into an indexed mesh: identical vertices are welded into one, the triangles are
+// reordered for the post-transform vertex cache (Tipsify, Sander et al. 2007) and the
+// vertices are stored in the order they are first used, so fetches stay sequential.
+//
+// cache efficiency is reported as ACMR, vertices transformed per triangle with a FIFO
+// cache of CACHE_SIZE entries: 3 for unindexed drawing, 0.5 at best on large regular meshes
+namespace mesh_builder
+{
+	const int CACHE_SIZE = 16;
+	const size_t MAX_VERTICES = 65536;	// 16-bit indices
+
+	struct Report
+	{
+		int inputVertices;
+		int outputVertices;
+		float weldedACMR;		// welded, triangles in authoring order
+		float optimizedACMR;	// after reordering
+	};
+
+	// average cache misses per triangle of indices, simulating a FIFO cache
+	// ------------------------------------------------------------------------
+	template <typename Index>
+	float acmr(const std::vector<Index>& indices, int cacheSize = CACHE_SIZE)
+	{
+		if (indices.size() < 3)
+			return 0.0f;
+		std::vector<uint32_t> cache(cacheSize, 0xFFFFFFFFu);
+		size_t next = 0;
+		int misses = 0;
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			if (std::find(cache.begin(), cache.end(), (uint32_t)indices[i]) != cache.end())
+				continue;
+			cache[next] = (uint32_t)indices[i];
+			next = (next + 1) % cache.size();
+			misses++;
+		}
+		return (float)misses / (indices.size() / 3);
+	}
+
+	// merges bitwise identical vertices; indices refer to the welded vertices, which are
+	// numbered in the order they first appear
+	// ------------------------------------------------------------------------
+	inline void weld(const float* vertices, int numVertices, int floatsPerVertex, std::vector<float>& outVertices, std::vector<uint32_t>& outIndices)
+	{
+		const size_t stride = floatsPerVertex * sizeof(float);
+
+		// sort the corners so identical ones are adjacent, then map each to its first copy
+		std::vector<uint32_t> order(numVertices);
+		for (int i = 0; i < numVertices; i++)
+			order[i] = (uint32_t)i;
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return memcmp(vertices + a * floatsPerVertex, vertices + b * floatsPerVertex, stride) < 0;
+		});
+		std::vector<uint32_t> firstCopy(numVertices);
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			bool same = i > 0 && memcmp(vertices + order[i] * floatsPerVertex, vertices + order[i - 1] * floatsPerVertex, stride) == 0;
+			firstCopy[order[i]] = same ? firstCopy[order[i - 1]] : order[i];
+		}
+
+		std::vector<uint32_t> remap(numVertices, 0xFFFFFFFFu);
+		outVertices.clear();
+		outIndices.clear();
+		outIndices.reserve(numVertices);
+		for (int i = 0; i < numVertices; i++)
+		{
+			uint32_t& index = remap[firstCopy[i]];
+			if (index == 0xFFFFFFFFu)
+			{
+				index = (uint32_t)(outVertices.size() / floatsPerVertex);
+				outVertices.insert(outVertices.end(), vertices + i * floatsPerVertex, vertices + (i + 1) * floatsPerVertex);
+			}
+			outIndices.push_back(index);
+		}
+	}
+
+	// reorders the triangles of an indexed mesh for a vertex cache of cacheSize entries.
+	// fans around one vertex at a time and moves on to the neighbour that is still in the
+	// cache and has the most triangles left, falling back to recently used vertices and
+	// then to the next unfinished one in order when the fan reaches a dead end
+	// ------------------------------------------------------------------------
+	inline void tipsify(std::vector<uint32_t>& indices, int vertexCount, int cacheSize = CACHE_SIZE)
+	{
+		const int triangleCount = (int)indices.size() / 3;
+		if (triangleCount == 0)
+			return;
+
+		// triangles using each vertex, as offsets into one array
+		std::vector<int> live(vertexCount, 0);
+		for (size_t i = 0; i < indices.size(); i++)
+			live[indices[i]]++;
+		std::vector<int> adjacencyStart(vertexCount + 1, 0);
+		for (int v = 0; v < vertexCount; v++)
+			adjacencyStart[v + 1] = adjacencyStart[v] + live[v];
+		std::vector<int> adjacency(indices.size());
+		std::vector<int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (int t = 0; t < triangleCount; t++)
+		{
+			for (int c = 0; c < 3; c++)
+				adjacency[fill[indices[3 * t + c]]++] = t;
+		}
+
+		std::vector<int> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<int> deadEnd;
+		std::vector<int> candidates;
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+
+		int time = cacheSize + 1;
+		int cursor = 0;
+		int fan = 0;
+		while (fan >= 0)
+		{
+			candidates.clear();
+			for (int a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; a++)
+			{
+				int t = adjacency[a];
+				if (emitted[t])
+					continue;
+				for (int c = 0; c < 3; c++)
+				{
+					int v = (int)indices[3 * t + c];
+					output.push_back((uint32_t)v);
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					live[v]--;
+					if (time - cacheTime[v] > cacheSize)
+						cacheTime[v] = time++;
+				}
+				emitted[t] = true;
+			}
+
+			// next fan: the candidate that will still be cached after its remaining triangles
+			int best = -1;
+			int bestPriority = -1;
+			for (size_t i = 0; i < candidates.size(); i++)
+			{
+				int v = candidates[i];
+				if (live[v] <= 0)
+					continue;
+				int priority = 0;
+				if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+					priority = time - cacheTime[v];
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					best = v;
+				}
+			}
+			if (best < 0)
+			{
+				while (!deadEnd.empty() && best < 0)
+				{
+					int v = deadEnd.back();
+					deadEnd.pop_back();
+					if (live[v] > 0)
+						best = v;
+				}
+				while (best < 0 && cursor < vertexCount)
+				{
+					if (live[cursor] > 0)
+						best = cursor;
+					cursor++;
+				}
+			}
+			fan = best;
+		}
+		indices.swap(output);
+	}
+
+	// renumbers the vertices in the order the indices first reference them
+	// ------------------------------------------------------------------------
+	inline void reorderVertices(std::vector<float>& vertices, std::vector<uint32_t>& indices, int floatsPerVertex)
+	{
+		std::vector<uint32_t> remap(vertices.size() / floatsPerVertex, 0xFFFFFFFFu);
+		std::vector<float> reordered;
+		reordered.reserve(vertices.size());
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			uint32_t& index = remap[indices[i]];
+			if (index == 0xFFFFFFFFu)
+			{
+				index = (uint32_t)(reordered.size() / floatsPerVertex);
+				reordered.insert(reordered.end(), vertices.begin() + indices[i] * floatsPerVertex, vertices.begin() + (indices[i] + 1) * floatsPerVertex);
+			}
+			indices[i] = index;
+		}
+		vertices.swap(reordered);
+	}
+
+	// welds, optimizes and narrows an expanded triangle list to 16-bit indices. returns
+	// false, leaving the outputs empty, if more than MAX_VERTICES distinct vertices remain
+	// ------------------------------------------------------------------------
+	inline bool build(const float* vertices, int numVertices, int floatsPerVertex, std::vector<float>& outVertices, std::vector<uint16_t>& outIndices, Report* report = NULL)
+	{
+		std::vector<uint32_t> indices;
+		weld(vertices, numVertices, floatsPerVertex, outVertices, indices);
+		const int welded = (int)(outVertices.size() / floatsPerVertex);
+		outIndices.clear();
+		if ((size_t)welded > MAX_VERTICES)
+		{
+			outVertices.clear();
+			return false;
+		}
+
+		float weldedACMR = acmr(indices);
+		tipsify(indices, welded);
+		reorderVertices(outVertices, indices, floatsPerVertex);
+		outIndices.assign(indices.begin(), indices.end());
+		if (report)
+		{
+			report->inputVertices = numVertices;
+			report->outputVertices = welded;
+			report->weldedACMR = weldedACMR;
+			report->optimizedACMR = acmr(outIndices);
+		}
+		return true;
+	}
+}
+
+#endif
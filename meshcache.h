@@ -0,0 +1,56 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include "cylinder.h"
+
+#include <map>
+#include <memory>
+#include <tuple>
+
+// keeps one static_meshes_3D::Cylinder per distinct set of construction parameters, so
+// the vertex data and GPU buffers of a cylinder are built once instead of every frame
+class MeshCache
+{
+public:
+	// radius, slices, height and the with* flags packed into a bit mask
+	typedef std::tuple<float, int, float, int> CylinderKey;
+
+	MeshCache() {}
+	MeshCache(const MeshCache&) = delete;
+	MeshCache& operator=(const MeshCache&) = delete;
+
+	// returns a shared handle to the cylinder with these parameters, building it on first use
+	// ------------------------------------------------------------------------
+	static_meshes_3D::Cylinder* cylinder(float radius, int numSlices, float height, bool withPositions = true, bool withTextureCoordinates = true, bool withNormals = true)
+	{
+		int flags = (withPositions ? 1 : 0) | (withTextureCoordinates ? 2 : 0) | (withNormals ? 4 : 0);
+		CylinderKey key(radius, numSlices, height, flags);
+
+		std::map<CylinderKey, std::unique_ptr<static_meshes_3D::Cylinder> >::iterator it = cylinders.find(key);
+		if (it == cylinders.end())
+		{
+			std::unique_ptr<static_meshes_3D::Cylinder> mesh(new static_meshes_3D::Cylinder(radius, numSlices, height, withPositions, withTextureCoordinates, withNormals));
+			it = cylinders.insert(std::make_pair(key, std::move(mesh))).first;
+		}
+		return it->second.get();
+	}
+
+	// number of distinct meshes currently held
+	// ------------------------------------------------------------------------
+	size_t size() const
+	{
+		return cylinders.size();
+	}
+
+	// destroys every cached mesh (and with it its GPU buffers); needs a current GL context
+	// ------------------------------------------------------------------------
+	void clear()
+	{
+		cylinders.clear();
+	}
+
+private:
+	std::map<CylinderKey, std::unique_ptr<static_meshes_3D::Cylinder> > cylinders;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <vector>
+
+// procedural geometry in the same interleaved layout as the hand written arrays in main:
+// 3 floats position followed by 2 floats texture coordinate, drawn as GL_TRIANGLES
+namespace primitives
+{
+	const int FLOATS_PER_VERTEX = 5;
+
+	inline void pushVertex(std::vector<float>& out, float x, float y, float z, float u, float v)
+	{
+		out.push_back(x);
+		out.push_back(y);
+		out.push_back(z);
+		out.push_back(u);
+		out.push_back(v);
+	}
+
+	// cylinder centered on the origin along the y axis, matching static_meshes_3D::Cylinder
+	// ------------------------------------------------------------------------
+	inline std::vector<float> cylinderVertices(float radius, int numSlices, float height, bool withCaps = true)
+	{
+		std::vector<float> out;
+		out.reserve((withCaps ? 12 : 6) * numSlices * FLOATS_PER_VERTEX);
+
+		const float halfHeight = height / 2.0f;
+		const float sliceAngle = 2.0f * 3.14159265358979f / numSlices;
+		for (int i = 0; i < numSlices; i++)
+		{
+			float a0 = i * sliceAngle;
+			float a1 = (i + 1) * sliceAngle;
+			float x0 = std::cos(a0), z0 = std::sin(a0);
+			float x1 = std::cos(a1), z1 = std::sin(a1);
+			float u0 = (float)i / numSlices;
+			float u1 = (float)(i + 1) / numSlices;
+
+			// side
+			pushVertex(out, x0 * radius, halfHeight, z0 * radius, u0, 1.0f);
+			pushVertex(out, x0 * radius, -halfHeight, z0 * radius, u0, 0.0f);
+			pushVertex(out, x1 * radius, -halfHeight, z1 * radius, u1, 0.0f);
+			pushVertex(out, x1 * radius, -halfHeight, z1 * radius, u1, 0.0f);
+			pushVertex(out, x1 * radius, halfHeight, z1 * radius, u1, 1.0f);
+			pushVertex(out, x0 * radius, halfHeight, z0 * radius, u0, 1.0f);
+
+			if (!withCaps)
+				continue;
+
+			// top and bottom caps
+			pushVertex(out, 0.0f, halfHeight, 0.0f, 0.5f, 0.5f);
+			pushVertex(out, x1 * radius, halfHeight, z1 * radius, x1 * 0.5f + 0.5f, z1 * 0.5f + 0.5f);
+			pushVertex(out, x0 * radius, halfHeight, z0 * radius, x0 * 0.5f + 0.5f, z0 * 0.5f + 0.5f);
+			pushVertex(out, 0.0f, -halfHeight, 0.0f, 0.5f, 0.5f);
+			pushVertex(out, x0 * radius, -halfHeight, z0 * radius, x0 * 0.5f + 0.5f, z0 * 0.5f + 0.5f);
+			pushVertex(out, x1 * radius, -halfHeight, z1 * radius, x1 * 0.5f + 0.5f, z1 * 0.5f + 0.5f);
+		}
+		return out;
+	}
+}
+
+#endif
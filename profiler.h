@@ -0,0 +1,328 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// frame profiler: named CPU sections timed on the host, and GL_TIME_ELAPSED queries
+// around groups of draws. the queries of a frame are only read back one frame later
+// from a second set, so reading them never waits for the GPU; if the results are still
+// not available by then that frame's GPU timings are dropped rather than stalling.
+//
+// averages are returned by summary() for display, and every sample can also be written
+// to a Chrome trace (chrome://tracing, ui.perfetto.dev) with CPU and GPU on two tracks
+class Profiler
+{
+public:
+	static const int FRAMES_IN_FLIGHT = 2;
+
+	Profiler()
+		: enabled(false), trace(NULL), firstEvent(true), frame(0), frameStart(0.0), activeCpu(NULL), activeCpuStart(0.0),
+		activeGroup(-1), cpuFrames(0), gpuFrames(0), droppedFrames(0)
+	{
+		start = std::chrono::steady_clock::now();
+	}
+
+	~Profiler()
+	{
+		closeTrace();
+	}
+
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	// turns profiling on; every call is a no-op until then. traceFile may be empty
+	// ------------------------------------------------------------------------
+	void enable(const std::string& traceFile = "")
+	{
+		enabled = true;
+		if (traceFile.empty() || trace)
+			return;
+		trace = fopen(traceFile.c_str(), "w");
+		if (!trace)
+		{
+			std::cout << "Failed to open trace file: " << traceFile << std::endl;
+			return;
+		}
+		fprintf(trace, "[\n");
+		fprintf(trace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+		fprintf(trace, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+		firstEvent = false;
+	}
+
+	bool isEnabled() const
+	{
+		return enabled;
+	}
+
+	// registers a named group of draws timed on the GPU
+	// ------------------------------------------------------------------------
+	int addGpuGroup(const std::string& name)
+	{
+		gpuGroups.push_back(Section(name));
+		return (int)gpuGroups.size() - 1;
+	}
+
+	// milliseconds since the profiler was created
+	// ------------------------------------------------------------------------
+	double now() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void beginFrame()
+	{
+		if (!enabled)
+			return;
+		frameStart = now();
+	}
+
+	// times the CPU from here until the next beginCpu() or endCpu()
+	// ------------------------------------------------------------------------
+	void beginCpu(const char* name)
+	{
+		if (!enabled)
+			return;
+		endCpu();
+		activeCpu = name;
+		activeCpuStart = now();
+	}
+
+	void endCpu()
+	{
+		if (!enabled || !activeCpu)
+			return;
+		addCpuSample(activeCpu, activeCpuStart, now());
+		activeCpu = NULL;
+	}
+
+	// records a finished CPU section, times from now()
+	// ------------------------------------------------------------------------
+	void addCpuSample(const char* name, double begin, double end)
+	{
+		if (!enabled)
+			return;
+		size_t i = 0;
+		while (i < cpuSections.size() && cpuSections[i].name != name)
+			i++;
+		if (i == cpuSections.size())
+			cpuSections.push_back(Section(name));
+		cpuSections[i].total += end - begin;
+		writeEvent(cpuSections[i].traceName.c_str(), 1, begin, end - begin);
+	}
+
+	// starts timing draws of group on the GPU, ending the running group; -1 stops timing
+	// ------------------------------------------------------------------------
+	void beginGpu(int group)
+	{
+		if (!enabled || group == activeGroup)
+			return;
+		endGpu();
+		if (group < 0 || group >= (int)gpuGroups.size())
+			return;
+		QuerySet& set = queries[frame % FRAMES_IN_FLIGHT];
+		if (set.used == set.ids.size())
+		{
+			unsigned int id;
+			glGenQueries(1, &id);
+			set.ids.push_back(id);
+			set.groups.push_back(0);
+		}
+		set.groups[set.used] = group;
+		glBeginQuery(GL_TIME_ELAPSED, set.ids[set.used]);
+		set.used++;
+		activeGroup = group;
+	}
+
+	void endGpu()
+	{
+		if (!enabled || activeGroup < 0)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		activeGroup = -1;
+	}
+
+	// closes the frame and reads back the GPU timings of the previous one
+	// ------------------------------------------------------------------------
+	void endFrame()
+	{
+		if (!enabled)
+			return;
+		endCpu();
+		endGpu();
+		queries[frame % FRAMES_IN_FLIGHT].frameStart = frameStart;
+		cpuFrames++;
+		frame++;
+		collect(queries[frame % FRAMES_IN_FLIGHT]);
+	}
+
+	// per frame averages since the last call, e.g. "cpu input 0.01 ... | gpu boxes 0.02 ... ms"
+	// ------------------------------------------------------------------------
+	std::string summary()
+	{
+		std::ostringstream out;
+		out.setf(std::ios::fixed);
+		out.precision(2);
+		out << "cpu";
+		for (size_t i = 0; i < cpuSections.size(); i++)
+		{
+			out << " " << cpuSections[i].name << " " << (cpuFrames ? cpuSections[i].total / cpuFrames : 0.0);
+			cpuSections[i].total = 0.0;
+		}
+		out << " | gpu";
+		for (size_t i = 0; i < gpuGroups.size(); i++)
+		{
+			out << " " << gpuGroups[i].name << " " << (gpuFrames ? gpuGroups[i].total / gpuFrames : 0.0);
+			gpuGroups[i].total = 0.0;
+		}
+		out << " ms";
+		if (droppedFrames)
+			out << " (" << droppedFrames << " gpu frames dropped)";
+		cpuFrames = 0;
+		gpuFrames = 0;
+		droppedFrames = 0;
+		return out.str();
+	}
+
+	// finishes and closes the trace file, if any
+	// ------------------------------------------------------------------------
+	void closeTrace()
+	{
+		if (!trace)
+			return;
+		fprintf(trace, "\n]\n");
+		fclose(trace);
+		trace = NULL;
+	}
+
+	void deleteQueries()
+	{
+		for (int i = 0; i < FRAMES_IN_FLIGHT; i++)
+		{
+			if (!queries[i].ids.empty())
+				glDeleteQueries((GLsizei)queries[i].ids.size(), &queries[i].ids[0]);
+			queries[i].ids.clear();
+			queries[i].groups.clear();
+			queries[i].used = 0;
+		}
+	}
+
+private:
+	struct Section
+	{
+		std::string name;
+		std::string traceName;	// name as a JSON string body
+		double total;	// milliseconds since the last summary()
+
+		Section(const std::string& name)
+			: name(name), traceName(escapeJson(name)), total(0.0)
+		{
+		}
+	};
+
+	// group names come from scene files, so quotes, backslashes and control characters
+	// must not end up in the trace as they are
+	static std::string escapeJson(const std::string& text)
+	{
+		std::string escaped;
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			const unsigned char c = (unsigned char)text[i];
+			if (c == '"' || c == '\\')
+			{
+				escaped += '\\';
+				escaped += (char)c;
+			}
+			else if (c < 0x20)
+			{
+				char code[8];
+				snprintf(code, sizeof(code), "\\u%04x", c);
+				escaped += code;
+			}
+			else
+				escaped += (char)c;
+		}
+		return escaped;
+	}
+
+	// the queries issued during one frame
+	struct QuerySet
+	{
+		std::vector<unsigned int> ids;
+		std::vector<int> groups;
+		size_t used;
+		double frameStart;
+
+		QuerySet()
+			: used(0), frameStart(0.0)
+		{
+		}
+	};
+
+	// queries finish in order, so the last one being available means all of them are.
+	// elapsed time queries carry no timestamps, so in the trace a frame's GPU groups are
+	// laid end to end from the CPU start of that frame
+	void collect(QuerySet& set)
+	{
+		if (set.used == 0)
+			return;
+		GLint available = 0;
+		glGetQueryObjectiv(set.ids[set.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+		{
+			droppedFrames++;
+			set.used = 0;
+			return;
+		}
+		double time = set.frameStart;
+		for (size_t i = 0; i < set.used; i++)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(set.ids[i], GL_QUERY_RESULT, &elapsed);
+			double duration = elapsed / 1.0e6;
+			gpuGroups[set.groups[i]].total += duration;
+			writeEvent(gpuGroups[set.groups[i]].traceName.c_str(), 2, time, duration);
+			time += duration;
+		}
+		set.used = 0;
+		gpuFrames++;
+	}
+
+	// one complete ("X") event, times in milliseconds; the trace format wants microseconds.
+	// name must already be escaped
+	void writeEvent(const char* name, int track, double begin, double duration)
+	{
+		if (!trace)
+			return;
+		fprintf(trace, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			firstEvent ? "" : ",\n", name, track, begin * 1000.0, duration * 1000.0);
+		firstEvent = false;
+	}
+
+	bool enabled;
+	std::chrono::steady_clock::time_point start;
+	FILE* trace;
+	bool firstEvent;
+
+	unsigned int frame;
+	double frameStart;
+	const char* activeCpu;
+	double activeCpuStart;
+	int activeGroup;
+	QuerySet queries[FRAMES_IN_FLIGHT];
+
+	std::vector<Section> cpuSections;
+	std::vector<Section> gpuGroups;
+	int cpuFrames;
+	int gpuFrames;
+	int droppedFrames;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+#include "mappedfile.h"
+#include "texturecache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+// on-disk cache of linked shader programs as returned by glGetProgramBinary, one file
+// per program. the key hashes the shader sources together with the driver's vendor,
+// renderer and version strings, so editing a shader or updating the driver simply misses
+// the cache; a binary the driver still rejects falls back to compiling from source.
+//
+// layout: Header, then header.length bytes of program binary
+namespace program_cache
+{
+	const uint32_t VERSION = 1;
+	const uint64_t HASH_SEED = 14695981039346656037ull;
+
+	struct Header
+	{
+		char magic[4];			// "VLPB"
+		uint32_t version;
+		uint64_t key;			// hash of the sources and the driver strings
+		uint32_t binaryFormat;	// as reported by glGetProgramBinary
+		uint32_t length;
+	};
+
+	static_assert(sizeof(Header) == 24, "program cache header must have no padding");
+
+	// 64-bit FNV-1a, continued from hash
+	// ------------------------------------------------------------------------
+	inline uint64_t hash(const void* data, size_t size, uint64_t hash = HASH_SEED)
+	{
+		const unsigned char* bytes = (const unsigned char*)data;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// hashes a string including its terminator, so consecutive strings cannot run together
+	// ------------------------------------------------------------------------
+	inline uint64_t hash(const std::string& text, uint64_t previous)
+	{
+		return hash(text.c_str(), text.size() + 1, previous);
+	}
+
+	inline std::string cachePath(const std::string& directory, uint64_t key)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.vlpb", (unsigned long long)key);
+		return directory + "/" + name;
+	}
+
+	inline void ensureDirectory(const std::string& directory)
+	{
+#ifdef _WIN32
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+	}
+
+	// checks that a mapped cache file is complete and belongs to key
+	// ------------------------------------------------------------------------
+	inline bool validate(const MappedFile& file, uint64_t key)
+	{
+		if (file.size() < sizeof(Header))
+			return false;
+		const Header* header = (const Header*)file.data();
+		if (header->magic[0] != 'V' || header->magic[1] != 'L' || header->magic[2] != 'P' || header->magic[3] != 'B')
+			return false;
+		if (header->version != VERSION || header->key != key || header->length == 0)
+			return false;
+		return header->length <= file.size() - sizeof(Header);
+	}
+
+	// writes header and binary through a temporary file of its own, like the texture cache
+	// ------------------------------------------------------------------------
+	inline bool write(const std::string& path, uint64_t key, uint32_t binaryFormat, const void* binary, uint32_t length)
+	{
+		Header header;
+		header.magic[0] = 'V';
+		header.magic[1] = 'L';
+		header.magic[2] = 'P';
+		header.magic[3] = 'B';
+		header.version = VERSION;
+		header.key = key;
+		header.binaryFormat = binaryFormat;
+		header.length = length;
+
+		std::string temporary = texture_cache::temporaryPath(path);
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (!file)
+			return false;
+		bool ok = fwrite(&header, sizeof(Header), 1, file) == 1;
+		ok = ok && fwrite(binary, 1, length, file) == length;
+		ok = (fclose(file) == 0) && ok;
+
+		if (ok)
+		{
+			remove(path.c_str());
+			ok = rename(temporary.c_str(), path.c_str()) == 0;
+		}
+		if (!ok)
+			remove(temporary.c_str());
+		return ok;
+	}
+}
+
+#endif
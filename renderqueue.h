@@ -0,0 +1,497 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "bounds.h"
+#include "profiler.h"
+#include "streambuffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// a draw that persists across frames, with its world space bounds for culling
+struct Renderable
+{
+	int program;
+	int geometry;
+	float layer;
+	glm::mat4 model;
+	int first;
+	int count;
+	int baseVertex;	// added to every index of indexed geometry
+	AABB bounds;
+	int lodGroup;	// index of the geometry's level of detail group, -1 if it has none
+	int lodLevel;	// level currently drawn, kept between frames for hysteresis
+	int profileGroup;	// Profiler GPU group the draw is timed in, -1 if it is not timed
+
+	Renderable(int program, int geometry, float layer, const glm::mat4& model, const AABB& localBounds, int first = 0, int count = 0, int baseVertex = 0)
+		: program(program), geometry(geometry), layer(layer), model(model), first(first), count(count), baseVertex(baseVertex), bounds(localBounds.transformed(model)),
+		lodGroup(-1), lodLevel(0), profileGroup(-1)
+	{
+	}
+};
+
+// collects the frame's draws as compact commands, sorts them by a 64-bit key and then
+// executes them while skipping every program, texture layer and vertex array change that
+// would rebind what is already bound.
+//
+// key layout, most significant bits first:
+//	program (8) | texture layer (8) | geometry (16) | view depth (32)
+// so draws are grouped by state and, within a group, drawn front to back.
+//
+// streamed programs take their model matrix and texture layer from an Object uniform
+// block instead of uniforms: execute() writes the records of all their draws into a
+// StreamBuffer in one pass and binds them OBJECT_RECORDS at a time, normally once per
+// frame. a draw then only sets the index of its record, the current value of the
+// disabled vertex attribute OBJECT_INDEX_ATTRIB
+//
+//	struct ObjectRecord
+//	{
+//		mat4 model;
+//		vec4 material;	// x is the texture layer
+//	};
+//	layout (std140) uniform Object
+//	{
+//		ObjectRecord objects[OBJECT_RECORDS];
+//	};
+//	layout (location = OBJECT_INDEX_ATTRIB) in uint aObject;
+class RenderQueue
+{
+	// one queued draw; transform indexes the transforms of the list holding it
+	struct Command
+	{
+		uint64_t key;
+		uint32_t transform;
+		uint16_t program;
+		uint16_t geometry;
+		int16_t profileGroup;
+		float layer;
+		int32_t first;
+		int32_t count;
+		int32_t baseVertex;
+	};
+
+public:
+	static const int NO_UNIFORM = Shader::INVALID_HANDLE;
+	static const unsigned int OBJECT_BINDING = 2;	// Camera uses 0, Clusters 1
+	static const int OBJECT_RECORDS = 128;	// 10 KB, within the 16 KB every block may use
+	static const unsigned int OBJECT_INDEX_ATTRIB = 9;	// no vertex array enables it
+
+	// one record of the Object block
+	struct ObjectData
+	{
+		glm::mat4 model;
+		glm::vec4 material;
+	};
+	static_assert(sizeof(ObjectData) == 80, "records are packed at the std140 array stride");
+
+	// draws recorded apart from the queue, one list per thread, and appended to it with
+	// append(); recording only computes sort keys and makes no GL calls
+	class CommandList
+	{
+	public:
+		// starts a new frame; depth in the sort key is measured from eye
+		// ------------------------------------------------------------------------
+		void begin(const glm::vec3& eye)
+		{
+			cameraPosition = eye;
+			commands.clear();
+			transforms.clear();
+		}
+
+		// queues one draw; first, count and baseVertex are only used by vertex array geometry
+		// ------------------------------------------------------------------------
+		void submit(int program, int geometry, float layer, const glm::mat4& model, int first = 0, int count = 0, int baseVertex = 0, int profileGroup = -1)
+		{
+			Command command;
+			command.program = (uint16_t)program;
+			command.geometry = (uint16_t)geometry;
+			command.profileGroup = (int16_t)profileGroup;
+			command.layer = layer;
+			command.transform = (uint32_t)transforms.size();
+			command.first = first;
+			command.count = count;
+			command.baseVertex = baseVertex;
+
+			glm::vec3 offset = glm::vec3(model[3]) - cameraPosition;
+			float depth = glm::dot(offset, offset);
+			uint32_t depthBits;
+			memcpy(&depthBits, &depth, sizeof(depthBits)); // non-negative floats sort like their bits
+			command.key = ((uint64_t)(program & 0xFF) << 56)
+				| ((uint64_t)((int)layer & 0xFF) << 48)
+				| ((uint64_t)(geometry & 0xFFFF) << 32)
+				| depthBits;
+
+			transforms.push_back(model);
+			commands.push_back(command);
+		}
+
+		void submit(const Renderable& renderable)
+		{
+			submit(renderable.program, renderable.geometry, renderable.layer, renderable.model, renderable.first, renderable.count, renderable.baseVertex, renderable.profileGroup);
+		}
+
+		size_t size() const
+		{
+			return commands.size();
+		}
+
+	private:
+		friend class RenderQueue;
+
+		std::vector<Command> commands;
+		std::vector<glm::mat4> transforms;
+		glm::vec3 cameraPosition;
+	};
+
+	// state changes issued and filtered out by the last execute()
+	struct Stats
+	{
+		int commands;
+		int programChanges;
+		int layerChanges;
+		int geometryChanges;
+		int objectBinds;	// Object ranges bound, one per OBJECT_RECORDS records
+		int recordChanges;	// record indexes set for streamed draws
+		int avoided;
+	};
+
+	RenderQueue()
+		: profiler(NULL), stream(NULL)
+	{
+		memset(&stats, 0, sizeof(stats));
+	}
+
+	// times the draws of each profile group on the GPU; NULL turns timing off
+	// ------------------------------------------------------------------------
+	void setProfiler(Profiler* gpuProfiler)
+	{
+		profiler = gpuProfiler;
+	}
+
+	// where streamed programs get their per-draw data from; needed before execute()
+	// ------------------------------------------------------------------------
+	void setStreamBuffer(StreamBuffer* buffer)
+	{
+		stream = buffer;
+	}
+
+	// points the program's Object block at OBJECT_BINDING; false if it declares none
+	// ------------------------------------------------------------------------
+	static bool attachObjectBlock(unsigned int program)
+	{
+		unsigned int index = glGetUniformBlockIndex(program, "Object");
+		if (index == GL_INVALID_INDEX)
+			return false;
+		glUniformBlockBinding(program, index, OBJECT_BINDING);
+		return true;
+	}
+
+	// registers a program; the handles name its per-draw uniforms, if it has any
+	// ------------------------------------------------------------------------
+	int addProgram(Shader* shader, Shader::Handle modelHandle = NO_UNIFORM, Shader::Handle layerHandle = NO_UNIFORM)
+	{
+		Program program;
+		program.shader = shader;
+		program.modelHandle = modelHandle;
+		program.layerHandle = layerHandle;
+		program.streamed = false;
+		programs.push_back(program);
+		return (int)programs.size() - 1;
+	}
+
+	// registers a program reading its model matrix and layer from the Object block
+	// ------------------------------------------------------------------------
+	int addStreamedProgram(Shader* shader)
+	{
+		int program = addProgram(shader);
+		programs[program].streamed = true;
+		return program;
+	}
+
+	// registers a VAO drawn with glDrawArrays
+	// ------------------------------------------------------------------------
+	int addVertexArray(unsigned int VAO, GLenum mode = GL_TRIANGLES)
+	{
+		Geometry geometry;
+		geometry.VAO = VAO;
+		geometry.mode = mode;
+		geometry.indexType = 0;
+		geometry.render = NULL;
+		geometry.mesh = NULL;
+		geometries.push_back(geometry);
+		return (int)geometries.size() - 1;
+	}
+
+	// registers a VAO with an element buffer, drawn with glDrawElementsBaseVertex; first
+	// and count of its draws address the element buffer
+	// ------------------------------------------------------------------------
+	int addIndexedArray(unsigned int VAO, GLenum indexType = GL_UNSIGNED_SHORT, GLenum mode = GL_TRIANGLES)
+	{
+		int geometry = addVertexArray(VAO, mode);
+		geometries[geometry].indexType = indexType;
+		return geometry;
+	}
+
+	// registers a mesh that binds its own buffers in render() (Cylinder, InstancedMesh)
+	// ------------------------------------------------------------------------
+	template <typename Mesh>
+	int addMesh(const Mesh* mesh)
+	{
+		for (size_t i = 0; i < geometries.size(); i++)
+		{
+			if (geometries[i].mesh == mesh)
+				return (int)i;
+		}
+		Geometry geometry;
+		geometry.VAO = 0;
+		geometry.mode = GL_TRIANGLES;
+		geometry.indexType = 0;
+		geometry.render = &renderMesh<Mesh>;
+		geometry.mesh = mesh;
+		geometries.push_back(geometry);
+		return (int)geometries.size() - 1;
+	}
+
+	// starts a new frame; depth in the sort key is measured from eye
+	// ------------------------------------------------------------------------
+	void begin(const glm::vec3& eye)
+	{
+		queued.begin(eye);
+	}
+
+	// queues one draw; first, count and baseVertex are only used by vertex array geometry
+	// ------------------------------------------------------------------------
+	void submit(int program, int geometry, float layer, const glm::mat4& model, int first = 0, int count = 0, int baseVertex = 0, int profileGroup = -1)
+	{
+		queued.submit(program, geometry, layer, model, first, count, baseVertex, profileGroup);
+	}
+
+	void submit(const Renderable& renderable)
+	{
+		queued.submit(renderable);
+	}
+
+	// adds the draws of a list recorded for the same eye as begin()
+	// ------------------------------------------------------------------------
+	void append(const CommandList& list)
+	{
+		const uint32_t transformBase = (uint32_t)queued.transforms.size();
+		queued.transforms.insert(queued.transforms.end(), list.transforms.begin(), list.transforms.end());
+		for (size_t i = 0; i < list.commands.size(); i++)
+		{
+			queued.commands.push_back(list.commands[i]);
+			queued.commands.back().transform += transformBase;
+		}
+	}
+
+	// sorts the queued commands by key
+	// ------------------------------------------------------------------------
+	void sort()
+	{
+		std::sort(queued.commands.begin(), queued.commands.end(), [](const Command& a, const Command& b) { return a.key < b.key; });
+	}
+
+	// issues the queued commands in order, filtering redundant state changes
+	// ------------------------------------------------------------------------
+	void execute()
+	{
+		memset(&stats, 0, sizeof(stats));
+		const std::vector<Command>& commands = queued.commands;
+		stats.commands = (int)commands.size();
+
+		// the object records of the streamed draws, in draw order. consecutive draws with the
+		// same model matrix and layer, like the identity batches of StaticBatcher, share one
+		// record and so neither write nor set anything new. records are packed at the std140
+		// array stride, each full block of OBJECT_RECORDS starting on a bindable offset
+		recordOf.assign(commands.size(), -1);
+		size_t blockSize = 0;
+		size_t recordBase = 0;
+		bool recorded = false;
+		if (stream)
+		{
+			const size_t alignment = stream->getOffsetAlignment();
+			blockSize = (OBJECT_RECORDS * sizeof(ObjectData) + alignment - 1) / alignment * alignment;
+			int records = 0;
+			const Command* previous = NULL;
+			for (size_t i = 0; i < commands.size(); i++)
+			{
+				const Command& command = commands[i];
+				if (!programs[command.program].streamed)
+					continue;
+				if (!previous || previous->layer != command.layer || queued.transforms[previous->transform] != queued.transforms[command.transform])
+					records++;
+				recordOf[i] = records - 1;
+				previous = &command;
+			}
+			if (records > 0)
+			{
+				// the last block is bound whole too, so it is reserved whole
+				const size_t bytes = (records + OBJECT_RECORDS - 1) / OBJECT_RECORDS * blockSize;
+				unsigned char* data = (unsigned char*)stream->begin(bytes);
+				int written = -1;
+				for (size_t i = 0; data && i < commands.size(); i++)
+				{
+					if (recordOf[i] <= written)
+						continue;
+					ObjectData record;
+					record.model = queued.transforms[commands[i].transform];
+					record.material = glm::vec4(commands[i].layer, 0.0f, 0.0f, 0.0f);
+					memcpy(data + recordOf[i] / OBJECT_RECORDS * blockSize + recordOf[i] % OBJECT_RECORDS * sizeof(ObjectData), &record, sizeof(record));
+					written = recordOf[i];
+				}
+				stream->end(data ? bytes : 0);
+				recordBase = stream->getOffset();
+				recorded = data != NULL;
+			}
+		}
+
+		int currentProgram = -1;
+		int currentGeometry = -1;
+		float currentLayer = -1.0f;
+		int currentBlock = -1;
+		int currentIndex = -1;
+		for (size_t i = 0; i < commands.size(); i++)
+		{
+			const Command& command = commands[i];
+			const Program& program = programs[command.program];
+			const Geometry& geometry = geometries[command.geometry];
+
+			// the stream could not be mapped; drawing would read a stale record
+			if (program.streamed && !recorded)
+				continue;
+
+			// sorting interleaves the groups, a group may be timed by several queries
+			if (profiler)
+				profiler->beginGpu(command.profileGroup);
+
+			if (command.program != currentProgram)
+			{
+				program.shader->use();
+				currentProgram = command.program;
+				currentLayer = -1.0f;
+				stats.programChanges++;
+			}
+			else
+			{
+				stats.avoided++;
+			}
+
+			if (program.layerHandle != NO_UNIFORM)
+			{
+				if (command.layer != currentLayer)
+				{
+					program.shader->setFloat(program.layerHandle, command.layer);
+					currentLayer = command.layer;
+					stats.layerChanges++;
+				}
+				else
+				{
+					stats.avoided++;
+				}
+			}
+
+			if (program.modelHandle != NO_UNIFORM)
+				program.shader->setMat4(program.modelHandle, queued.transforms[command.transform]);
+
+			if (program.streamed)
+			{
+				const int block = recordOf[i] / OBJECT_RECORDS;
+				const int index = recordOf[i] % OBJECT_RECORDS;
+				if (block != currentBlock)
+				{
+					glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_BINDING, stream->getBuffer(), recordBase + block * blockSize, blockSize);
+					currentBlock = block;
+					stats.objectBinds++;
+				}
+				if (index != currentIndex)
+				{
+					glVertexAttribI1ui(OBJECT_INDEX_ATTRIB, (GLuint)index);
+					currentIndex = index;
+					stats.recordChanges++;
+				}
+				else
+				{
+					stats.avoided++;
+				}
+			}
+
+			if (geometry.render)
+			{
+				// the mesh binds its own vertex array
+				if (command.geometry != currentGeometry)
+					stats.geometryChanges++;
+				geometry.render(geometry.mesh);
+			}
+			else
+			{
+				if (command.geometry != currentGeometry)
+				{
+					glBindVertexArray(geometry.VAO);
+					stats.geometryChanges++;
+				}
+				else
+				{
+					stats.avoided++;
+				}
+				if (geometry.indexType == GL_UNSIGNED_SHORT)
+					glDrawElementsBaseVertex(geometry.mode, command.count, GL_UNSIGNED_SHORT, (void*)(command.first * sizeof(unsigned short)), command.baseVertex);
+				else if (geometry.indexType == GL_UNSIGNED_INT)
+					glDrawElementsBaseVertex(geometry.mode, command.count, GL_UNSIGNED_INT, (void*)(command.first * sizeof(unsigned int)), command.baseVertex);
+				else
+					glDrawArrays(geometry.mode, command.first, command.count);
+			}
+			currentGeometry = command.geometry;
+		}
+		if (profiler)
+			profiler->endGpu();
+		if (recorded)
+			stream->fence();
+	}
+
+	const Stats& getStats() const
+	{
+		return stats;
+	}
+
+private:
+	typedef void (*RenderFunction)(const void* mesh);
+
+	template <typename Mesh>
+	static void renderMesh(const void* mesh)
+	{
+		((const Mesh*)mesh)->render();
+	}
+
+	struct Program
+	{
+		Shader* shader;
+		Shader::Handle modelHandle;
+		Shader::Handle layerHandle;
+		bool streamed;	// model and layer come from the Object block
+	};
+
+	struct Geometry
+	{
+		unsigned int VAO;
+		GLenum mode;
+		GLenum indexType;	// 0 for glDrawArrays
+		RenderFunction render;
+		const void* mesh;
+	};
+
+	std::vector<Program> programs;
+	std::vector<Geometry> geometries;
+	CommandList queued;
+	Stats stats;
+	Profiler* profiler;
+	StreamBuffer* stream;
+	std::vector<int> recordOf;	// per queued command, its Object record or -1
+};
+
+#endif
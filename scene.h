@@ -0,0 +1,509 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "mappedfile.h"
+#include "meshbuilder.h"
+#include "texturecache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// scenes are authored as text and compiled into a packed binary file that is memory
+// mapped at runtime; vertex and index data are handed to GL straight from the mapping.
+//
+// text format, one statement per line, # starts a comment:
+//	mesh <name>						starts a mesh, followed by its vertices
+//	v <x y z> <u v>					one corner, every three form a triangle
+//	end								closes the mesh
+//	material <name> <texture file>
+//	object <group> <mesh> <material or -> <lit|lamp> [translate x y z] [scale x y z] [rotate degrees x y z]
+// object transforms are applied in the order translate, scale, rotate.
+//
+// the compiler welds each mesh's corners into indexed vertices and orders its triangles
+// for the vertex cache (see meshbuilder.h).
+//
+// binary layout: Header, vertices, 16-bit indices (padded to 4 bytes), then the Mesh,
+// Material, Name (groups) and Object tables; all offsets are from the start of the file
+namespace scene_format
+{
+	const uint32_t VERSION = 2;
+	const int FLOATS_PER_VERTEX = 5;
+	const int NAME_LENGTH = 32;
+	const int PATH_LENGTH = 96;
+
+	enum Program
+	{
+		PROGRAM_LIT = 0,
+		PROGRAM_LAMP = 1
+	};
+
+	struct Header
+	{
+		char magic[4];			// "VLSC"
+		uint32_t version;
+		uint64_t sourceSize;	// size and modification time of the text source,
+		int64_t sourceTime;		// used to detect a stale binary
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t meshCount;
+		uint32_t materialCount;
+		uint32_t groupCount;
+		uint32_t objectCount;
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		uint64_t meshOffset;
+		uint64_t materialOffset;
+		uint64_t groupOffset;
+		uint64_t objectOffset;
+	};
+
+	// a range of the shared index buffer; its indices are relative to baseVertex
+	struct Mesh
+	{
+		char name[NAME_LENGTH];
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t baseVertex;
+		uint32_t vertexCount;
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	struct Material
+	{
+		char name[NAME_LENGTH];
+		char texture[PATH_LENGTH];
+	};
+
+	struct Name
+	{
+		char name[NAME_LENGTH];
+	};
+
+	struct Object
+	{
+		float model[16];
+		uint32_t mesh;
+		int32_t material;		// -1 for untextured objects
+		uint32_t program;
+		uint32_t group;
+	};
+
+	static_assert(sizeof(Header) == 96, "scene header must have no padding");
+	static_assert(sizeof(Mesh) == 72, "scene mesh must have no padding");
+	static_assert(sizeof(Material) == 128, "scene material must have no padding");
+	static_assert(sizeof(Object) == 80, "scene object must have no padding");
+
+	// compiled file name of a text scene: its extension replaced by .vlsc
+	// ------------------------------------------------------------------------
+	inline std::string binaryPath(const std::string& sourcePath)
+	{
+		size_t dot = sourcePath.find_last_of('.');
+		size_t slash = sourcePath.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return sourcePath + ".vlsc";
+		return sourcePath.substr(0, dot) + ".vlsc";
+	}
+
+	inline void copyName(char* out, const std::string& name, size_t size)
+	{
+		memset(out, 0, size);
+		strncpy(out, name.c_str(), size - 1);
+	}
+
+	template <typename T>
+	int findNamed(const std::vector<T>& items, const std::string& name)
+	{
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			if (name == items[i].name)
+				return (int)i;
+		}
+		return -1;
+	}
+
+	inline bool compileError(const std::string& path, int line, const std::string& message)
+	{
+		std::cout << path << "(" << line << "): " << message << std::endl;
+		return false;
+	}
+
+	// parses the text scene at sourcePath and writes its binary form to outputPath
+	// ------------------------------------------------------------------------
+	inline bool compile(const std::string& sourcePath, const std::string& outputPath)
+	{
+		std::ifstream source(sourcePath.c_str());
+		if (!source)
+		{
+			std::cout << "Failed to open scene: " << sourcePath << std::endl;
+			return false;
+		}
+
+		std::vector<float> vertices;
+		std::vector<uint16_t> indices;
+		std::vector<Mesh> meshes;
+		std::vector<Material> materials;
+		std::vector<Name> groups;
+		std::vector<Object> objects;
+
+		bool inMesh = false;
+		std::vector<float> corners;
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(source, line))
+		{
+			lineNumber++;
+			size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.erase(comment);
+			std::istringstream in(line);
+			std::string keyword;
+			if (!(in >> keyword))
+				continue;
+
+			if (keyword == "mesh")
+			{
+				std::string name;
+				if (inMesh || !(in >> name))
+					return compileError(sourcePath, lineNumber, "expected: mesh <name>, outside of another mesh");
+				if (findNamed(meshes, name) >= 0)
+					return compileError(sourcePath, lineNumber, "mesh " + name + " is already defined");
+				Mesh mesh;
+				copyName(mesh.name, name, sizeof(mesh.name));
+				mesh.firstIndex = (uint32_t)indices.size();
+				mesh.indexCount = 0;
+				mesh.baseVertex = (uint32_t)(vertices.size() / FLOATS_PER_VERTEX);
+				mesh.vertexCount = 0;
+				meshes.push_back(mesh);
+				corners.clear();
+				inMesh = true;
+			}
+			else if (keyword == "v")
+			{
+				float v[FLOATS_PER_VERTEX];
+				if (!inMesh || !(in >> v[0] >> v[1] >> v[2] >> v[3] >> v[4]))
+					return compileError(sourcePath, lineNumber, "expected: v x y z u v, inside a mesh");
+				Mesh& mesh = meshes.back();
+				for (int i = 0; i < 3; i++)
+				{
+					bool first = corners.empty();
+					mesh.boundsMin[i] = first ? v[i] : std::min(mesh.boundsMin[i], v[i]);
+					mesh.boundsMax[i] = first ? v[i] : std::max(mesh.boundsMax[i], v[i]);
+				}
+				corners.insert(corners.end(), v, v + FLOATS_PER_VERTEX);
+			}
+			else if (keyword == "end")
+			{
+				int cornerCount = (int)corners.size() / FLOATS_PER_VERTEX;
+				if (!inMesh || cornerCount == 0 || cornerCount % 3 != 0)
+					return compileError(sourcePath, lineNumber, "a mesh must end after a whole number of triangles");
+				std::vector<float> meshVertices;
+				std::vector<uint16_t> meshIndices;
+				mesh_builder::Report report;
+				if (!mesh_builder::build(&corners[0], cornerCount, FLOATS_PER_VERTEX, meshVertices, meshIndices, &report))
+					return compileError(sourcePath, lineNumber, "mesh has more than 65536 distinct vertices, split it");
+				Mesh& mesh = meshes.back();
+				mesh.indexCount = (uint32_t)meshIndices.size();
+				mesh.vertexCount = (uint32_t)report.outputVertices;
+				vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+				indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+				std::cout << "mesh " << mesh.name << ": " << report.inputVertices << " -> " << report.outputVertices << " vertices, ACMR 3.00 unindexed, "
+					<< report.weldedACMR << " welded, " << report.optimizedACMR << " optimized" << std::endl;
+				inMesh = false;
+			}
+			else if (keyword == "material")
+			{
+				std::string name, texture;
+				if (inMesh || !(in >> name >> texture))
+					return compileError(sourcePath, lineNumber, "expected: material <name> <texture file>");
+				if (texture.size() >= (size_t)PATH_LENGTH)
+					return compileError(sourcePath, lineNumber, "texture path is too long");
+				Material material;
+				copyName(material.name, name, sizeof(material.name));
+				copyName(material.texture, texture, sizeof(material.texture));
+				materials.push_back(material);
+			}
+			else if (keyword == "object")
+			{
+				std::string group, meshName, materialName, programName;
+				if (inMesh || !(in >> group >> meshName >> materialName >> programName))
+					return compileError(sourcePath, lineNumber, "expected: object <group> <mesh> <material> <program> ...");
+
+				Object object;
+				int mesh = findNamed(meshes, meshName);
+				if (mesh < 0)
+					return compileError(sourcePath, lineNumber, "unknown mesh " + meshName);
+				object.mesh = (uint32_t)mesh;
+				object.material = materialName == "-" ? -1 : findNamed(materials, materialName);
+				if (materialName != "-" && object.material < 0)
+					return compileError(sourcePath, lineNumber, "unknown material " + materialName);
+				if (programName == "lit")
+					object.program = PROGRAM_LIT;
+				else if (programName == "lamp")
+					object.program = PROGRAM_LAMP;
+				else
+					return compileError(sourcePath, lineNumber, "unknown program " + programName);
+				int groupIndex = findNamed(groups, group);
+				if (groupIndex < 0)
+				{
+					Name name;
+					copyName(name.name, group, sizeof(name.name));
+					groups.push_back(name);
+					groupIndex = (int)groups.size() - 1;
+				}
+				object.group = (uint32_t)groupIndex;
+
+				glm::vec3 translation(0.0f), scale(1.0f), axis(0.0f, 1.0f, 0.0f);
+				float angle = 0.0f;
+				std::string transform;
+				while (in >> transform)
+				{
+					bool ok;
+					if (transform == "translate")
+						ok = (bool)(in >> translation.x >> translation.y >> translation.z);
+					else if (transform == "scale")
+						ok = (bool)(in >> scale.x >> scale.y >> scale.z);
+					else if (transform == "rotate")
+						ok = (bool)(in >> angle >> axis.x >> axis.y >> axis.z);
+					else
+						ok = false;
+					if (!ok)
+						return compileError(sourcePath, lineNumber, "expected: translate x y z, scale x y z or rotate degrees x y z");
+				}
+				glm::mat4 model = glm::translate(glm::mat4(1.0f), translation);
+				model = glm::scale(model, scale);
+				model = glm::rotate(model, glm::radians(angle), axis);
+				memcpy(object.model, &model[0][0], sizeof(object.model));
+				objects.push_back(object);
+			}
+			else
+			{
+				return compileError(sourcePath, lineNumber, "unknown statement " + keyword);
+			}
+		}
+		if (inMesh)
+			return compileError(sourcePath, lineNumber, "missing end of mesh " + std::string(meshes.back().name));
+
+		Header header;
+		memset(&header, 0, sizeof(header));
+		header.magic[0] = 'V';
+		header.magic[1] = 'L';
+		header.magic[2] = 'S';
+		header.magic[3] = 'C';
+		header.version = VERSION;
+		texture_cache::sourceStamp(sourcePath, header.sourceSize, header.sourceTime);
+		header.vertexCount = (uint32_t)(vertices.size() / FLOATS_PER_VERTEX);
+		header.indexCount = (uint32_t)indices.size();
+		header.meshCount = (uint32_t)meshes.size();
+		header.materialCount = (uint32_t)materials.size();
+		header.groupCount = (uint32_t)groups.size();
+		header.objectCount = (uint32_t)objects.size();
+		header.vertexOffset = sizeof(Header);
+		header.indexOffset = header.vertexOffset + vertices.size() * sizeof(float);
+		if (indices.size() % 2 != 0)
+			indices.push_back(0);	// keeps the tables after the indices 4-byte aligned
+		header.meshOffset = header.indexOffset + indices.size() * sizeof(uint16_t);
+		header.materialOffset = header.meshOffset + meshes.size() * sizeof(Mesh);
+		header.groupOffset = header.materialOffset + materials.size() * sizeof(Material);
+		header.objectOffset = header.groupOffset + groups.size() * sizeof(Name);
+
+		// same as the texture cache: write a temporary file of our own and rename it over
+		// the old one, so concurrent compiles of the scene never share a temporary file
+		std::string temporary = texture_cache::temporaryPath(outputPath);
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (!file)
+		{
+			std::cout << "Failed to write scene: " << outputPath << std::endl;
+			return false;
+		}
+		bool ok = fwrite(&header, sizeof(Header), 1, file) == 1;
+		ok = ok && (vertices.empty() || fwrite(&vertices[0], sizeof(float), vertices.size(), file) == vertices.size());
+		ok = ok && (indices.empty() || fwrite(&indices[0], sizeof(uint16_t), indices.size(), file) == indices.size());
+		ok = ok && (meshes.empty() || fwrite(&meshes[0], sizeof(Mesh), meshes.size(), file) == meshes.size());
+		ok = ok && (materials.empty() || fwrite(&materials[0], sizeof(Material), materials.size(), file) == materials.size());
+		ok = ok && (groups.empty() || fwrite(&groups[0], sizeof(Name), groups.size(), file) == groups.size());
+		ok = ok && (objects.empty() || fwrite(&objects[0], sizeof(Object), objects.size(), file) == objects.size());
+		ok = (fclose(file) == 0) && ok;
+		if (ok)
+		{
+			remove(outputPath.c_str());
+			ok = rename(temporary.c_str(), outputPath.c_str()) == 0;
+		}
+		if (!ok)
+		{
+			remove(temporary.c_str());
+			std::cout << "Failed to write scene: " << outputPath << std::endl;
+		}
+		return ok;
+	}
+}
+
+// a compiled scene, mapped read-only; every table is used in place without parsing
+class SceneFile
+{
+public:
+	SceneFile()
+		: VAO(0), header(NULL), VBO(0), EBO(0)
+	{
+	}
+
+	SceneFile(const SceneFile&) = delete;
+	SceneFile& operator=(const SceneFile&) = delete;
+
+	// maps the compiled form of the text scene at sourcePath, compiling it first if the
+	// binary is missing or older than the source. a binary without its source is used as is
+	// ------------------------------------------------------------------------
+	bool open(const std::string& sourcePath)
+	{
+		std::string path = scene_format::binaryPath(sourcePath);
+		uint64_t sourceSize = 0;
+		int64_t sourceTime = 0;
+		bool hasSource = texture_cache::sourceStamp(sourcePath, sourceSize, sourceTime);
+		if (map(path) && (!hasSource || (header->sourceSize == sourceSize && header->sourceTime == sourceTime)))
+			return true;
+		close();
+		if (!hasSource || !scene_format::compile(sourcePath, path))
+			return false;
+		if (map(path))
+			return true;
+		close();
+		return false;
+	}
+
+	void close()
+	{
+		file.close();
+		header = NULL;
+	}
+
+	// uploads the vertex and index blobs into one vertex array, reading them from the mapping
+	// ------------------------------------------------------------------------
+	void upload()
+	{
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)header->vertexCount * scene_format::FLOATS_PER_VERTEX * sizeof(float), file.data() + header->vertexOffset, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)header->indexCount * sizeof(uint16_t), file.data() + header->indexOffset, GL_STATIC_DRAW);
+
+		// position attribute
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, scene_format::FLOATS_PER_VERTEX * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		// texture coord attribute
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, scene_format::FLOATS_PER_VERTEX * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+		glBindVertexArray(0);
+	}
+
+	void deleteBuffers()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
+	}
+
+	int meshCount() const { return (int)header->meshCount; }
+	int materialCount() const { return (int)header->materialCount; }
+	int groupCount() const { return (int)header->groupCount; }
+	int objectCount() const { return (int)header->objectCount; }
+	int vertexCount() const { return (int)header->vertexCount; }
+	int indexCount() const { return (int)header->indexCount; }
+
+	const float* vertices() const
+	{
+		return (const float*)(file.data() + header->vertexOffset);
+	}
+
+	const uint16_t* indices() const
+	{
+		return (const uint16_t*)(file.data() + header->indexOffset);
+	}
+
+	const scene_format::Mesh& mesh(int i) const
+	{
+		return ((const scene_format::Mesh*)(file.data() + header->meshOffset))[i];
+	}
+
+	const scene_format::Material& material(int i) const
+	{
+		return ((const scene_format::Material*)(file.data() + header->materialOffset))[i];
+	}
+
+	const char* group(int i) const
+	{
+		return ((const scene_format::Name*)(file.data() + header->groupOffset))[i].name;
+	}
+
+	const scene_format::Object& object(int i) const
+	{
+		return ((const scene_format::Object*)(file.data() + header->objectOffset))[i];
+	}
+
+	unsigned int VAO;
+
+private:
+	// maps path and checks that every table lies inside the file and references resolve
+	bool map(const std::string& path)
+	{
+		if (!file.open(path) || file.size() < sizeof(scene_format::Header))
+			return false;
+		const scene_format::Header* h = (const scene_format::Header*)file.data();
+		if (h->magic[0] != 'V' || h->magic[1] != 'L' || h->magic[2] != 'S' || h->magic[3] != 'C' || h->version != scene_format::VERSION)
+			return false;
+		if (!fits(h->vertexOffset, (uint64_t)h->vertexCount * scene_format::FLOATS_PER_VERTEX * sizeof(float))
+			|| !fits(h->indexOffset, (uint64_t)h->indexCount * sizeof(uint16_t))
+			|| !fits(h->meshOffset, (uint64_t)h->meshCount * sizeof(scene_format::Mesh))
+			|| !fits(h->materialOffset, (uint64_t)h->materialCount * sizeof(scene_format::Material))
+			|| !fits(h->groupOffset, (uint64_t)h->groupCount * sizeof(scene_format::Name))
+			|| !fits(h->objectOffset, (uint64_t)h->objectCount * sizeof(scene_format::Object)))
+			return false;
+		header = h;
+		for (int i = 0; i < meshCount(); i++)
+		{
+			const scene_format::Mesh& m = mesh(i);
+			if ((uint64_t)m.firstIndex + m.indexCount > header->indexCount
+				|| (uint64_t)m.baseVertex + m.vertexCount > header->vertexCount)
+				return false;
+			// an index past the mesh's own vertices would draw another mesh's, or none
+			const uint16_t* meshIndices = indices() + m.firstIndex;
+			for (uint32_t j = 0; j < m.indexCount; j++)
+			{
+				if (meshIndices[j] >= m.vertexCount)
+					return false;
+			}
+		}
+		for (int i = 0; i < objectCount(); i++)
+		{
+			const scene_format::Object& o = object(i);
+			if (o.mesh >= header->meshCount || o.material < -1 || o.material >= (int32_t)header->materialCount || o.group >= header->groupCount)
+				return false;
+		}
+		return true;
+	}
+
+	bool fits(uint64_t offset, uint64_t size) const
+	{
+		return offset % 4 == 0 && offset <= file.size() && size <= file.size() - offset;
+	}
+
+	MappedFile file;
+	const scene_format::Header* header;
+	unsigned int VBO, EBO;
+};
+
+#endif
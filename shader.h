@@ -0,0 +1,433 @@
+#ifndef SHADER_H
+#define SHADER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "glextensions.h"
+#include "programcache.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// a vertex/fragment (and optional geometry) program built from GLSL files, with the
+// interface of the LearnOpenGL Shader class. when a cache directory is set, linked
+// programs are stored with glGetProgramBinary and later launches load them with
+// glProgramBinary instead of compiling, see programcache.h. both come from
+// glextensions.h; without them the cache says so once and every program is compiled.
+//
+// every active uniform is reflected once after linking, so the setters never call
+// glGetUniformLocation. per-draw code resolves a name to an integer handle up front and
+// sets through that; either way the last value is kept and uploads that would not change
+// anything are skipped. set uniforms only through the Shader, or that copy goes stale
+class Shader
+{
+public:
+	typedef int Handle;
+	static const Handle INVALID_HANDLE = -1;
+
+	// programs loaded from the cache and compiled from source since startup
+	struct Stats
+	{
+		int cached;
+		int compiled;
+		double cachedMs;
+		double compiledMs;
+	};
+
+	unsigned int ID;
+
+	// constructor reads and builds the shader
+	// ------------------------------------------------------------------------
+	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::string vertexCode = readFile(vertexPath);
+		std::string fragmentCode = readFile(fragmentPath);
+		std::string geometryCode = geometryPath ? readFile(geometryPath) : std::string();
+
+		// the key covers everything that decides whether a stored binary is still valid
+		const std::string& directory = cacheDirectory();
+		const bool caching = !directory.empty() && binariesSupported();
+		if (!directory.empty() && !caching)
+			reportCacheUnavailable();
+		uint64_t key = 0;
+		std::string path;
+		if (caching)
+		{
+			const std::string parts[] = { vertexCode, fragmentCode, geometryCode,
+				glString(GL_VENDOR), glString(GL_RENDERER), glString(GL_VERSION), glString(GL_SHADING_LANGUAGE_VERSION) };
+			key = program_cache::HASH_SEED;
+			for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++)
+				key = program_cache::hash(parts[i], key);
+			path = program_cache::cachePath(directory, key);
+			if (loadBinary(path, key))
+			{
+				reflectUniforms();
+				double ms = elapsedMs(start);
+				stats().cached++;
+				stats().cachedMs += ms;
+				std::cout << "shader " << vertexPath << " + " << fragmentPath << ": from cache in " << ms << " ms" << std::endl;
+				return;
+			}
+		}
+
+		// compile shaders
+		unsigned int vertex = compile(vertexCode, GL_VERTEX_SHADER, "VERTEX");
+		unsigned int fragment = compile(fragmentCode, GL_FRAGMENT_SHADER, "FRAGMENT");
+		unsigned int geometry = geometryPath ? compile(geometryCode, GL_GEOMETRY_SHADER, "GEOMETRY") : 0;
+		// shader Program
+		ID = glCreateProgram();
+		glAttachShader(ID, vertex);
+		glAttachShader(ID, fragment);
+		if (geometryPath)
+			glAttachShader(ID, geometry);
+		if (caching)
+			glExtensions().programParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(ID);
+		bool linked = checkCompileErrors(ID, "PROGRAM");
+		// delete the shaders as they're linked into our program now and no longer necessary
+		glDeleteShader(vertex);
+		glDeleteShader(fragment);
+		if (geometryPath)
+			glDeleteShader(geometry);
+
+		if (caching && linked)
+			storeBinary(path, key);
+		reflectUniforms();
+		double ms = elapsedMs(start);
+		stats().compiled++;
+		stats().compiledMs += ms;
+		std::cout << "shader " << vertexPath << " + " << fragmentPath << ": compiled in " << ms << " ms" << std::endl;
+	}
+
+	// where linked programs are cached; empty (the default) turns the cache off
+	// ------------------------------------------------------------------------
+	static std::string& cacheDirectory()
+	{
+		static std::string directory;
+		return directory;
+	}
+
+	static Stats& stats()
+	{
+		static Stats totals = { 0, 0, 0.0, 0.0 };
+		return totals;
+	}
+
+	// activate the shader
+	// ------------------------------------------------------------------------
+	void use() const
+	{
+		glUseProgram(ID);
+	}
+	// handle for a uniform name, INVALID_HANDLE if the program has no such active uniform
+	// ------------------------------------------------------------------------
+	Handle handle(const std::string& name) const
+	{
+		std::unordered_map<std::string, Handle>::const_iterator it = handles.find(name);
+		return it == handles.end() ? INVALID_HANDLE : it->second;
+	}
+	// utility uniform functions; the shader must be in use
+	// ------------------------------------------------------------------------
+	void setBool(const std::string& name, bool value)
+	{
+		setInt(handle(name), (int)value);
+	}
+	// ------------------------------------------------------------------------
+	void setInt(const std::string& name, int value)
+	{
+		setInt(handle(name), value);
+	}
+	void setInt(Handle handle, int value)
+	{
+		if (changed(handle, &value, sizeof(int)))
+			glUniform1i(slots[handle].location, value);
+	}
+	// ------------------------------------------------------------------------
+	void setFloat(const std::string& name, float value)
+	{
+		setFloat(handle(name), value);
+	}
+	void setFloat(Handle handle, float value)
+	{
+		if (changed(handle, &value, sizeof(float)))
+			glUniform1f(slots[handle].location, value);
+	}
+	// ------------------------------------------------------------------------
+	void setVec2(const std::string& name, const glm::vec2& value)
+	{
+		setVec2(handle(name), value);
+	}
+	void setVec2(const std::string& name, float x, float y)
+	{
+		setVec2(handle(name), glm::vec2(x, y));
+	}
+	void setVec2(Handle handle, const glm::vec2& value)
+	{
+		if (changed(handle, &value[0], sizeof(glm::vec2)))
+			glUniform2fv(slots[handle].location, 1, &value[0]);
+	}
+	// ------------------------------------------------------------------------
+	void setVec3(const std::string& name, const glm::vec3& value)
+	{
+		setVec3(handle(name), value);
+	}
+	void setVec3(const std::string& name, float x, float y, float z)
+	{
+		setVec3(handle(name), glm::vec3(x, y, z));
+	}
+	void setVec3(Handle handle, const glm::vec3& value)
+	{
+		if (changed(handle, &value[0], sizeof(glm::vec3)))
+			glUniform3fv(slots[handle].location, 1, &value[0]);
+	}
+	// ------------------------------------------------------------------------
+	void setVec4(const std::string& name, const glm::vec4& value)
+	{
+		setVec4(handle(name), value);
+	}
+	void setVec4(const std::string& name, float x, float y, float z, float w)
+	{
+		setVec4(handle(name), glm::vec4(x, y, z, w));
+	}
+	void setVec4(Handle handle, const glm::vec4& value)
+	{
+		if (changed(handle, &value[0], sizeof(glm::vec4)))
+			glUniform4fv(slots[handle].location, 1, &value[0]);
+	}
+	// ------------------------------------------------------------------------
+	void setMat2(const std::string& name, const glm::mat2& mat)
+	{
+		const Handle slot = handle(name);
+		if (changed(slot, &mat[0][0], sizeof(glm::mat2)))
+			glUniformMatrix2fv(slots[slot].location, 1, GL_FALSE, &mat[0][0]);
+	}
+	// ------------------------------------------------------------------------
+	void setMat3(const std::string& name, const glm::mat3& mat)
+	{
+		const Handle slot = handle(name);
+		if (changed(slot, &mat[0][0], sizeof(glm::mat3)))
+			glUniformMatrix3fv(slots[slot].location, 1, GL_FALSE, &mat[0][0]);
+	}
+	// ------------------------------------------------------------------------
+	void setMat4(const std::string& name, const glm::mat4& mat)
+	{
+		setMat4(handle(name), mat);
+	}
+	void setMat4(Handle handle, const glm::mat4& mat)
+	{
+		if (changed(handle, &mat[0][0], sizeof(glm::mat4)))
+			glUniformMatrix4fv(slots[handle].location, 1, GL_FALSE, &mat[0][0]);
+	}
+
+	// forgets the last values, e.g. after uniforms were set behind the shader's back
+	// ------------------------------------------------------------------------
+	void invalidateUniforms()
+	{
+		for (size_t i = 0; i < slots.size(); i++)
+			slots[i].valid = false;
+	}
+
+	// number of set calls that were dropped because the value was already current
+	// ------------------------------------------------------------------------
+	unsigned long getSkippedUploads() const
+	{
+		return skippedUploads;
+	}
+
+private:
+	struct Slot
+	{
+		GLint location;
+		bool valid;
+		unsigned char value[sizeof(glm::mat4)];
+	};
+
+	std::vector<Slot> slots;
+	std::unordered_map<std::string, Handle> handles;
+	unsigned long skippedUploads = 0;
+
+	// resolves the location of every active uniform outside a uniform block
+	void reflectUniforms()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<char> name(maxLength > 0 ? maxLength : 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLint size;
+			GLenum type;
+			GLsizei length;
+			glGetActiveUniform(ID, i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+			std::string uniformName(&name[0], length);
+			GLint location = glGetUniformLocation(ID, uniformName.c_str());
+			if (location < 0)
+				continue; // member of a uniform block
+
+			// arrays are reported once as "name[0]": every element gets a slot of its own
+			// and the plain name resolves to the first
+			const size_t suffix = uniformName.size() >= 3 ? uniformName.size() - 3 : 0;
+			if (uniformName.compare(suffix, std::string::npos, "[0]") != 0)
+			{
+				addSlot(uniformName, location);
+				continue;
+			}
+			const std::string base = uniformName.substr(0, suffix);
+			handles[base] = addSlot(uniformName, location);
+			for (GLint element = 1; element < size; element++)
+			{
+				const std::string elementName = base + "[" + std::to_string(element) + "]";
+				GLint elementLocation = glGetUniformLocation(ID, elementName.c_str());
+				if (elementLocation >= 0)
+					addSlot(elementName, elementLocation);
+			}
+		}
+	}
+
+	Handle addSlot(const std::string& name, GLint location)
+	{
+		Slot slot;
+		slot.location = location;
+		slot.valid = false;
+		memset(slot.value, 0, sizeof(slot.value));
+		Handle handle = (Handle)slots.size();
+		slots.push_back(slot);
+		handles[name] = handle;
+		return handle;
+	}
+
+	// compares against and updates the last value, true when an upload is needed
+	bool changed(Handle handle, const void* value, size_t size)
+	{
+		if (handle < 0 || handle >= (Handle)slots.size())
+			return false;
+		Slot& slot = slots[handle];
+		if (slot.valid && memcmp(slot.value, value, size) == 0)
+		{
+			skippedUploads++;
+			return false;
+		}
+		memcpy(slot.value, value, size);
+		slot.valid = true;
+		return true;
+	}
+
+	static std::string readFile(const char* path)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+			return std::string();
+		}
+		std::stringstream stream;
+		stream << file.rdbuf();
+		return stream.str();
+	}
+
+	static std::string glString(GLenum name)
+	{
+		const GLubyte* value = glGetString(name);
+		return value ? std::string((const char*)value) : std::string();
+	}
+
+	static double elapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	static bool binariesSupported()
+	{
+		return glExtensions().programBinaries;
+	}
+
+	// a cache directory was set but the context can't use it; said once, not per program
+	static void reportCacheUnavailable()
+	{
+		static bool reported = false;
+		if (reported)
+			return;
+		reported = true;
+		std::cout << "shader cache: OpenGL " << glExtensions().major << "." << glExtensions().minor
+			<< " offers no program binaries, every program is compiled" << std::endl;
+	}
+
+	// creates ID from a cached binary; false if there is none or the driver rejects it
+	bool loadBinary(const std::string& path, uint64_t key)
+	{
+		MappedFile file;
+		if (!file.open(path) || !program_cache::validate(file, key))
+			return false;
+		const program_cache::Header* header = (const program_cache::Header*)file.data();
+		ID = glCreateProgram();
+		glExtensions().programBinary(ID, header->binaryFormat, file.data() + sizeof(program_cache::Header), (GLsizei)header->length);
+		GLint success = 0;
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		if (success)
+			return true;
+		glDeleteProgram(ID);
+		ID = 0;
+		return false;
+	}
+
+	void storeBinary(const std::string& path, uint64_t key) const
+	{
+		GLint length = 0;
+		glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+		std::vector<unsigned char> binary(length);
+		GLenum binaryFormat = 0;
+		glExtensions().getProgramBinary(ID, length, &length, &binaryFormat, &binary[0]);
+		program_cache::ensureDirectory(cacheDirectory());
+		if (!program_cache::write(path, key, binaryFormat, &binary[0], (uint32_t)length))
+			std::cout << "Failed to write program cache " << path << std::endl;
+	}
+
+	static unsigned int compile(const std::string& code, GLenum type, const std::string& typeName)
+	{
+		const char* source = code.c_str();
+		unsigned int shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+		checkCompileErrors(shader, typeName);
+		return shader;
+	}
+
+	// utility function for checking shader compilation/linking errors.
+	// ------------------------------------------------------------------------
+	static bool checkCompileErrors(GLuint shader, const std::string& type)
+	{
+		GLint success;
+		GLchar infoLog[1024];
+		if (type != "PROGRAM")
+		{
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+			if (!success)
+			{
+				glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+				std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+			}
+		}
+		else
+		{
+			glGetProgramiv(shader, GL_LINK_STATUS, &success);
+			if (!success)
+			{
+				glGetProgramInfoLog(shader, 1024, NULL, infoLog);
+				std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+			}
+		}
+		return success != 0;
+	}
+};
+
+#endif
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPos;
+};
+
+uniform mat4 model;
+
+void main()
+{
+	gl_Position = viewProjection * model * vec4(aPos, 1.0);
+}
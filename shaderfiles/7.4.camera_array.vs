@@ -0,0 +1,29 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+// static batches carry their texture layer per vertex; every other vertex array leaves
+// location 2 disabled, which reads as 0
+layout (location = 2) in float aLayer;
+
+out vec2 TexCoord;
+flat out float Layer;
+out vec3 WorldPos;
+
+uniform mat4 model;
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPos;
+};
+uniform float layer;
+
+void main()
+{
+	vec4 worldPos = model * vec4(aPos, 1.0f);
+	gl_Position = viewProjection * worldPos;
+	WorldPos = worldPos.xyz;
+	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+	Layer = layer + aLayer;
+}
@@ -0,0 +1,26 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 3) in mat4 aInstanceModel;
+layout (location = 7) in float aInstanceLayer;
+
+out vec2 TexCoord;
+flat out float Layer;
+out vec3 WorldPos;
+
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPos;
+};
+
+void main()
+{
+	vec4 worldPos = aInstanceModel * vec4(aPos, 1.0f);
+	gl_Position = viewProjection * worldPos;
+	WorldPos = worldPos.xyz;
+	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+	Layer = aInstanceLayer;
+}
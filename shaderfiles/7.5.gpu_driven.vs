@@ -0,0 +1,42 @@
+#version 430 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 8) in uint aObject;
+
+out vec2 TexCoord;
+flat out float Layer;
+out vec3 WorldPos;
+
+// same layout as in gpu_cull.cs
+struct Object
+{
+	mat4 model;
+	vec4 boundsMin;
+	vec4 boundsMax;
+	float layer;
+	uint indexCount;
+	uint firstIndex;
+	int baseVertex;
+};
+
+layout (std430, binding = 0) readonly buffer Objects
+{
+	Object objects[];
+};
+
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPos;
+};
+
+void main()
+{
+	vec4 worldPos = objects[aObject].model * vec4(aPos, 1.0f);
+	gl_Position = viewProjection * worldPos;
+	WorldPos = worldPos.xyz;
+	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+	Layer = objects[aObject].layer;
+}
@@ -0,0 +1,57 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+flat in float Layer;
+in vec3 WorldPos;
+
+// every scene texture lives in one layer of this array
+uniform sampler2DArray textures;
+
+// point lights assigned to view space clusters, see ClusteredLights
+uniform samplerBuffer lights;
+uniform usamplerBuffer clusters;
+uniform usamplerBuffer lightIndices;
+
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPos;
+};
+
+layout (std140) uniform Clusters
+{
+	uvec4 clusterCounts;
+	vec4 clusterScale;
+	vec4 ambient;
+};
+
+void main()
+{
+	vec4 color = texture(textures, vec3(TexCoord, Layer));
+
+	// the meshes carry no normals, so light the face the fragment belongs to
+	vec3 normal = normalize(cross(dFdx(WorldPos), dFdy(WorldPos)));
+
+	// cluster of this fragment: screen tile and depth slice
+	float depth = -(view * vec4(WorldPos, 1.0f)).z;
+	float slice = (clusterCounts.w != 0u ? log2(max(depth, 1e-4f)) : depth) * clusterScale.z + clusterScale.w;
+	ivec3 cell = clamp(ivec3(vec3(gl_FragCoord.xy * clusterScale.xy, slice)), ivec3(0), ivec3(clusterCounts.xyz) - 1);
+	int cluster = (cell.z * int(clusterCounts.y) + cell.y) * int(clusterCounts.x) + cell.x;
+	uvec2 range = texelFetch(clusters, cluster).xy;
+
+	vec3 lighting = ambient.rgb;
+	for (uint i = 0u; i < range.y; i++)
+	{
+		int light = int(texelFetch(lightIndices, int(range.x + i)).r);
+		vec4 positionRadius = texelFetch(lights, 2 * light);
+		vec4 colorIntensity = texelFetch(lights, 2 * light + 1);
+		vec3 toLight = positionRadius.xyz - WorldPos;
+		float distance = length(toLight);
+		float falloff = clamp(1.0f - distance / positionRadius.w, 0.0f, 1.0f);
+		lighting += colorIntensity.rgb * colorIntensity.a * falloff * falloff * max(dot(normal, toLight / max(distance, 1e-4f)), 0.0f);
+	}
+	FragColor = vec4(color.rgb * lighting, color.a);
+}
@@ -0,0 +1,41 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+// static batches carry their texture layer per vertex; every other vertex array leaves
+// location 2 disabled, which reads as 0
+layout (location = 2) in float aLayer;
+
+out vec2 TexCoord;
+flat out float Layer;
+out vec3 WorldPos;
+
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 cameraPos;
+};
+// the records bound from the stream buffer, RenderQueue::OBJECT_RECORDS of them, and the
+// index of this draw's record, which the queue sets as the current value of the disabled
+// location 9; material.x is the texture layer
+struct ObjectRecord
+{
+	mat4 model;
+	vec4 material;
+};
+layout (std140) uniform Object
+{
+	ObjectRecord objects[128];
+};
+layout (location = 9) in uint aObject;
+
+void main()
+{
+	ObjectRecord object = objects[aObject];
+	vec4 worldPos = object.model * vec4(aPos, 1.0f);
+	gl_Position = viewProjection * worldPos;
+	WorldPos = worldPos.xyz;
+	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+	Layer = object.material.x + aLayer;
+}
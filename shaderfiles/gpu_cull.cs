@@ -0,0 +1,64 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+// one per object, see GpuCuller::Object
+struct Object
+{
+	mat4 model;
+	vec4 boundsMin;
+	vec4 boundsMax;
+	float layer;
+	uint indexCount;
+	uint firstIndex;
+	int baseVertex;
+};
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout (std430, binding = 0) readonly buffer Objects
+{
+	Object objects[];
+};
+
+layout (std430, binding = 1) writeonly buffer Commands
+{
+	DrawCommand commands[];
+};
+
+// view frustum planes, normals pointing inwards
+uniform vec4 planes[6];
+uniform uint objectCount;
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= objectCount)
+		return;
+
+	vec3 center = (objects[i].boundsMin.xyz + objects[i].boundsMax.xyz) * 0.5;
+	vec3 extents = (objects[i].boundsMax.xyz - objects[i].boundsMin.xyz) * 0.5;
+	bool visible = true;
+	for (int p = 0; p < 6; p++)
+	{
+		float d = dot(planes[p].xyz, center) + planes[p].w;
+		float r = dot(abs(planes[p].xyz), extents);
+		if (d + r < 0.0)
+			visible = false;
+	}
+
+	// culled objects stay in the command list with no instances; the base instance
+	// selects the object's entry in the vertex shader
+	commands[i].count = objects[i].indexCount;
+	commands[i].instanceCount = visible ? 1u : 0u;
+	commands[i].firstIndex = objects[i].firstIndex;
+	commands[i].baseVertex = objects[i].baseVertex;
+	commands[i].baseInstance = i;
+}
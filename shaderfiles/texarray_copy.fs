@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D source;
+uniform float lod;
+
+void main()
+{
+	FragColor = textureLod(source, TexCoord, lod);
+}
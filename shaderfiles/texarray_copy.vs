@@ -0,0 +1,10 @@
+#version 330 core
+out vec2 TexCoord;
+
+void main()
+{
+	// fullscreen triangle built from the vertex id, no vertex buffer needed
+	vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	TexCoord = pos;
+	gl_Position = vec4(pos * 2.0f - 1.0f, 0.0f, 1.0f);
+}
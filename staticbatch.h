@@ -0,0 +1,247 @@
+#ifndef STATIC_BATCH_H
+#define STATIC_BATCH_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <cstdint>
+#include <vector>
+
+// merges static objects that share a program into one batch: their vertices are
+// transformed into world space once and all batches live in a single vertex/index buffer,
+// so a batch is one draw with an identity model matrix. each vertex carries the texture
+// array layer of its object in attribute LAYER_ATTRIB, which is how objects with
+// different textures still end up in the same draw.
+//
+// source meshes are referenced, not copied (e.g. straight from a mapped SceneFile), and
+// must stay valid while the batcher is used. editing an object only re-transforms and
+// re-uploads the vertex range of its batch on the next update()
+class StaticBatcher
+{
+public:
+	static const int SOURCE_FLOATS_PER_VERTEX = 5;	// position, texcoord
+	static const int FLOATS_PER_VERTEX = 6;			// position, texcoord, layer
+	static const unsigned int LAYER_ATTRIB = 2;
+
+	struct Batch
+	{
+		int program;
+		int profileGroup;	// of the first object added to the batch
+		std::vector<int> objects;
+		uint32_t firstVertex;
+		uint32_t vertexCount;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		AABB bounds;		// world space
+		bool dirty;
+	};
+
+	StaticBatcher()
+		: VAO(0), VBO(0), EBO(0), layoutDirty(false)
+	{
+	}
+
+	StaticBatcher(const StaticBatcher&) = delete;
+	StaticBatcher& operator=(const StaticBatcher&) = delete;
+
+	// adds an object drawing the indexed triangles of a position/texcoord mesh, with
+	// indices relative to vertices, from texture array layer; returns its id for
+	// setTransform()
+	// ------------------------------------------------------------------------
+	int add(int program, float layer, int profileGroup, const float* vertices, int vertexCount, const uint16_t* indices, int indexCount, const glm::mat4& model)
+	{
+		Object object;
+		object.vertices = vertices;
+		object.vertexCount = vertexCount;
+		object.indices = indices;
+		object.indexCount = indexCount;
+		object.model = model;
+		object.layer = layer;
+
+		size_t b = 0;
+		while (b < batches.size() && batches[b].program != program)
+			b++;
+		if (b == batches.size())
+		{
+			Batch batch;
+			batch.program = program;
+			batch.profileGroup = profileGroup;
+			batch.firstVertex = batch.vertexCount = batch.firstIndex = batch.indexCount = 0;
+			batch.dirty = true;
+			batches.push_back(batch);
+		}
+		object.batch = (int)b;
+		batches[b].objects.push_back((int)objects.size());
+		objects.push_back(object);
+		layoutDirty = true;
+		return (int)objects.size() - 1;
+	}
+
+	// moves a static object; its batch is rebuilt on the next update()
+	// ------------------------------------------------------------------------
+	void setTransform(int object, const glm::mat4& model)
+	{
+		objects[object].model = model;
+		batches[objects[object].batch].dirty = true;
+	}
+
+	// rebuilds what changed: everything after objects were added, otherwise only the
+	// vertex ranges of edited batches. returns true if any batch bounds changed
+	// ------------------------------------------------------------------------
+	bool update()
+	{
+		if (layoutDirty)
+		{
+			rebuildAll();
+			return true;
+		}
+		bool changed = false;
+		for (size_t b = 0; b < batches.size(); b++)
+		{
+			if (!batches[b].dirty)
+				continue;
+			if (!changed)
+				glBindBuffer(GL_ARRAY_BUFFER, VBO);
+			transformBatch(batches[b]);
+			glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)batches[b].firstVertex * FLOATS_PER_VERTEX * sizeof(float),
+				(GLsizeiptr)batches[b].vertexCount * FLOATS_PER_VERTEX * sizeof(float), &vertices[(size_t)batches[b].firstVertex * FLOATS_PER_VERTEX]);
+			batches[b].dirty = false;
+			changed = true;
+		}
+		if (changed)
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		return changed;
+	}
+
+	const std::vector<Batch>& getBatches() const
+	{
+		return batches;
+	}
+
+	int getObjectCount() const
+	{
+		return (int)objects.size();
+	}
+
+	void deleteBuffers()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
+	}
+
+	// draws use 32-bit indices into the merged buffers
+	unsigned int VAO;
+
+private:
+	struct Object
+	{
+		const float* vertices;
+		int vertexCount;
+		const uint16_t* indices;
+		int indexCount;
+		glm::mat4 model;
+		float layer;
+		int batch;
+	};
+
+	// lays the batches out back to back, fills both buffers and uploads them whole
+	void rebuildAll()
+	{
+		uint32_t vertexTotal = 0, indexTotal = 0;
+		for (size_t b = 0; b < batches.size(); b++)
+		{
+			Batch& batch = batches[b];
+			batch.firstVertex = vertexTotal;
+			batch.firstIndex = indexTotal;
+			batch.vertexCount = batch.indexCount = 0;
+			for (size_t i = 0; i < batch.objects.size(); i++)
+			{
+				batch.vertexCount += objects[batch.objects[i]].vertexCount;
+				batch.indexCount += objects[batch.objects[i]].indexCount;
+			}
+			vertexTotal += batch.vertexCount;
+			indexTotal += batch.indexCount;
+		}
+
+		vertices.resize((size_t)vertexTotal * FLOATS_PER_VERTEX);
+		std::vector<uint32_t> indices(indexTotal);
+		for (size_t b = 0; b < batches.size(); b++)
+		{
+			Batch& batch = batches[b];
+			transformBatch(batch);
+			uint32_t vertex = batch.firstVertex;
+			uint32_t index = batch.firstIndex;
+			for (size_t i = 0; i < batch.objects.size(); i++)
+			{
+				const Object& object = objects[batch.objects[i]];
+				for (int j = 0; j < object.indexCount; j++)
+					indices[index++] = vertex + object.indices[j];
+				vertex += object.vertexCount;
+			}
+			batch.dirty = false;
+		}
+
+		if (!VAO)
+		{
+			glGenVertexArrays(1, &VAO);
+			glGenBuffers(1, &VBO);
+			glGenBuffers(1, &EBO);
+		}
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		// edits re-upload vertex ranges, the indices only change with the layout
+		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.empty() ? NULL : &vertices[0], GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+
+		// position attribute
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
+		// texture coord attribute
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(3 * sizeof(float)));
+		glEnableVertexAttribArray(1);
+		// texture array layer attribute
+		glVertexAttribPointer(LAYER_ATTRIB, 1, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(5 * sizeof(float)));
+		glEnableVertexAttribArray(LAYER_ATTRIB);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		layoutDirty = false;
+	}
+
+	// writes the world space vertices of a batch into its range of the vertex array and
+	// recomputes its bounds
+	void transformBatch(Batch& batch)
+	{
+		batch.bounds = AABB();
+		float* out = &vertices[(size_t)batch.firstVertex * FLOATS_PER_VERTEX];
+		for (size_t i = 0; i < batch.objects.size(); i++)
+		{
+			const Object& object = objects[batch.objects[i]];
+			for (int v = 0; v < object.vertexCount; v++)
+			{
+				const float* in = object.vertices + v * SOURCE_FLOATS_PER_VERTEX;
+				glm::vec3 position = glm::vec3(object.model * glm::vec4(in[0], in[1], in[2], 1.0f));
+				batch.bounds.expand(AABB(position, position));
+				out[0] = position.x;
+				out[1] = position.y;
+				out[2] = position.z;
+				out[3] = in[3];
+				out[4] = in[4];
+				out[5] = object.layer;
+				out += FLOATS_PER_VERTEX;
+			}
+		}
+	}
+
+	std::vector<Object> objects;
+	std::vector<Batch> batches;
+	std::vector<float> vertices;	// world space copy, kept for partial re-uploads
+	unsigned int VBO, EBO;
+	bool layoutDirty;
+};
+
+#endif
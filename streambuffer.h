@@ -0,0 +1,184 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include "glextensions.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// a ring of REGIONS frame sized regions in one buffer for data written by the CPU every
+// frame and read by the GPU once. each frame writes its own region and fences it after
+// the draws that read it were issued; a region is only written again once its fence has
+// signaled, so the CPU never waits for the GPU unless it is REGIONS frames ahead and
+// never has the driver copy or rename the buffer.
+//
+// with GL 4.4 or ARB_buffer_storage, loaded at runtime by loadGLExtensions(), the buffer
+// is created with glBufferStorage and stays mapped persistently and coherently, so writes
+// go straight to memory the GPU reads. without it every frame maps just its region with
+// GL_MAP_UNSYNCHRONIZED_BIT, which the fences make safe, and unmaps it again before drawing
+class StreamBuffer
+{
+public:
+	static const int REGIONS = 3;
+
+	// target is the binding the buffer is used through (GL_UNIFORM_BUFFER etc.)
+	explicit StreamBuffer(GLenum target, size_t regionSize = 64 * 1024)
+		: target(target), buffer(0), regionSize(0), region(0), persistent(glExtensions().persistentBuffers), mapped(NULL), writing(NULL)
+	{
+		// other targets keep a conservative 256, what most drivers ask of any binding
+		GLint alignment = 256;
+		if (target == GL_UNIFORM_BUFFER)
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		offsetAlignment = alignment > 0 ? (size_t)alignment : 256;
+		for (int i = 0; i < REGIONS; i++)
+			fences[i] = 0;
+		create(regionSize);
+	}
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	bool isPersistent() const
+	{
+		return persistent;
+	}
+
+	// offsets of ranges bound from this buffer must be multiples of this
+	size_t getOffsetAlignment() const
+	{
+		return offsetAlignment;
+	}
+
+	unsigned int getBuffer() const
+	{
+		return buffer;
+	}
+
+	// moves to the next region, waiting for the GPU to finish reading it, grows the
+	// ring if bytes do not fit and returns where to write. valid until end()
+	// ------------------------------------------------------------------------
+	void* begin(size_t bytes)
+	{
+		region = (region + 1) % REGIONS;
+		if (bytes > regionSize)
+		{
+			// wait for every region before the storage goes away
+			for (int i = 0; i < REGIONS; i++)
+				waitFence(i);
+			destroy();
+			create(bytes + bytes / 2);
+		}
+		waitFence(region);
+		if (persistent)
+			writing = (unsigned char*)mapped + getOffset();
+		else
+		{
+			glBindBuffer(target, buffer);
+			writing = glMapBufferRange(target, getOffset(), regionSize,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT);
+		}
+		return writing;
+	}
+
+	// buffer offset of the region begin() returned
+	size_t getOffset() const
+	{
+		return (size_t)region * regionSize;
+	}
+
+	// makes the first bytes written since begin() visible to the GPU
+	// ------------------------------------------------------------------------
+	void end(size_t bytes)
+	{
+		if (!persistent && writing)
+		{
+			glBindBuffer(target, buffer);
+			if (bytes > 0)
+				glFlushMappedBufferRange(target, 0, bytes);
+			glUnmapBuffer(target);
+			glBindBuffer(target, 0);
+		}
+		writing = NULL;
+	}
+
+	// call once the draws reading the region were issued
+	// ------------------------------------------------------------------------
+	void fence()
+	{
+		if (fences[region])
+			glDeleteSync(fences[region]);
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	void deleteBuffers()
+	{
+		destroy();
+	}
+
+private:
+	void create(size_t size)
+	{
+		// every region starts on a bindable offset
+		regionSize = (size + offsetAlignment - 1) / offsetAlignment * offsetAlignment;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(target, buffer);
+		if (persistent)
+		{
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glExtensions().bufferStorage(target, REGIONS * regionSize, NULL, flags);
+			mapped = glMapBufferRange(target, 0, REGIONS * regionSize, flags);
+			// the storage allows write maps either way, so per-frame mapping still works
+			persistent = mapped != NULL;
+		}
+		else
+		{
+			glBufferData(target, REGIONS * regionSize, NULL, GL_STREAM_DRAW);
+		}
+		glBindBuffer(target, 0);
+	}
+
+	void destroy()
+	{
+		for (int i = 0; i < REGIONS; i++)
+		{
+			if (fences[i])
+				glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+		if (mapped)
+		{
+			glBindBuffer(target, buffer);
+			glUnmapBuffer(target);
+			glBindBuffer(target, 0);
+			mapped = NULL;
+		}
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+	}
+
+	void waitFence(int i)
+	{
+		if (!fences[i])
+			return;
+		// flush on the first wait so the fence is guaranteed to signal
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync(fences[i], flags, 1000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+		glDeleteSync(fences[i]);
+		fences[i] = 0;
+	}
+
+	GLenum target;
+	unsigned int buffer;
+	size_t regionSize;
+	size_t offsetAlignment;
+	int region;
+	bool persistent;
+	void* mapped;	// the whole buffer when persistent
+	void* writing;	// the current region between begin() and end()
+	GLsync fences[REGIONS];
+};
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+// packs the scene's 2D textures into the layers of one GL_TEXTURE_2D_ARRAY so every draw
+// samples the same texture object and only picks a layer, instead of rebinding textures.
+// sources of any size are resampled on the GPU into the fixed layer size, which also works
+// for block-compressed sources that could not be attached to a framebuffer
+class TextureArray
+{
+public:
+	TextureArray(int width, int height, int maxLayers)
+		: width(width), height(height), maxLayers(maxLayers), layerCount(0), mipsDirty(false),
+		copyShader("shaderfiles/texarray_copy.vs", "shaderfiles/texarray_copy.fs")
+	{
+		int levels = 1 + (int)std::floor(std::log2((float)std::max(width, height)));
+		glGenTextures(1, &ID);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+		for (int level = 0; level < levels; level++)
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, std::max(1, width >> level), std::max(1, height >> level), maxLayers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		glGenFramebuffers(1, &FBO);
+		glGenVertexArrays(1, &emptyVAO);
+
+		copyShader.use();
+		copyShader.setInt("source", 1);
+	}
+
+	TextureArray(const TextureArray&) = delete;
+	TextureArray& operator=(const TextureArray&) = delete;
+
+	// reserves a layer for a 2D texture and returns its index, or -1 once the array is full.
+	// the layer stays empty until fill() is called for the texture, which takes ownership
+	// of it
+	// ------------------------------------------------------------------------
+	int addLayer(unsigned int sourceTexture)
+	{
+		std::map<unsigned int, int>::const_iterator it = layers.find(sourceTexture);
+		if (it != layers.end())
+			return it->second;
+		if (layerCount == maxLayers)
+			return -1;
+		layers[sourceTexture] = layerCount;
+		return layerCount++;
+	}
+
+	// resamples the (fully uploaded) source texture into its layer and deletes it, so the
+	// scene's textures are not kept in memory twice. returns false, leaving the texture
+	// alone, if it has no layer; whoever handed the name out must forget it otherwise
+	// ------------------------------------------------------------------------
+	bool fill(unsigned int sourceTexture)
+	{
+		std::map<unsigned int, int>::const_iterator it = layers.find(sourceTexture);
+		if (it == layers.end())
+			return false;
+
+		GLint previousFBO, previousProgram, previousVAO, previousViewport[4];
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFBO);
+		glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVAO);
+		glGetIntegerv(GL_VIEWPORT, previousViewport);
+		GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+		// sample a mip level close to the target size so downscaling does not alias
+		GLint sourceWidth, sourceHeight;
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, sourceTexture);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &sourceWidth);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &sourceHeight);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		float ratio = std::max((float)sourceWidth / width, (float)sourceHeight / height);
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, FBO);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, ID, 0, it->second);
+		glViewport(0, 0, width, height);
+		glDisable(GL_DEPTH_TEST);
+		copyShader.use();
+		copyShader.setFloat("lod", ratio > 1.0f ? std::log2(ratio) : 0.0f);
+		glBindVertexArray(emptyVAO);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glDeleteTextures(1, &sourceTexture);
+		glActiveTexture(GL_TEXTURE0);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, previousFBO);
+		glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+		glUseProgram(previousProgram);
+		glBindVertexArray(previousVAO);
+		if (depthTest)
+			glEnable(GL_DEPTH_TEST);
+		mipsDirty = true;
+
+		// GL may hand the name out again; it no longer refers to this layer
+		layers.erase(it);
+		return true;
+	}
+
+	// regenerates the array's mipmaps after layers changed, then leaves it bound to unit
+	// ------------------------------------------------------------------------
+	void update(unsigned int unit = 0)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, ID);
+		if (mipsDirty)
+		{
+			glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+			mipsDirty = false;
+		}
+	}
+
+	// layer reserved for sourceTexture, -1 if it was never added or is already filled
+	// ------------------------------------------------------------------------
+	int layerOf(unsigned int sourceTexture) const
+	{
+		std::map<unsigned int, int>::const_iterator it = layers.find(sourceTexture);
+		return it == layers.end() ? -1 : it->second;
+	}
+
+	void deleteArray()
+	{
+		glDeleteTextures(1, &ID);
+		glDeleteFramebuffers(1, &FBO);
+		glDeleteVertexArrays(1, &emptyVAO);
+		glDeleteProgram(copyShader.ID);
+		ID = FBO = emptyVAO = 0;
+	}
+
+	unsigned int ID;
+
+private:
+	int width, height;
+	int maxLayers;
+	int layerCount;
+	bool mipsDirty;
+	std::map<unsigned int, int> layers;
+
+	unsigned int FBO;
+	unsigned int emptyVAO;
+	Shader copyShader;
+};
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include "mappedfile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+// on-disk texture cache: one file per source image holding the full mip chain, either as
+// raw pixels or as the block-compressed payload the driver produced, so later launches
+// skip image decoding and mipmap generation and hand the mapped levels straight to GL.
+//
+// layout: Header, Level[header.levels], then the payload of every level
+namespace texture_cache
+{
+	const uint32_t VERSION = 1;
+
+	struct Header
+	{
+		char magic[4];			// "VLTX"
+		uint32_t version;
+		uint64_t sourceSize;	// size and modification time of the source image,
+		int64_t sourceTime;		// used to detect a stale cache file
+		uint32_t width;
+		uint32_t height;
+		uint32_t components;
+		uint32_t flip;
+		uint32_t compressed;	// payload is glCompressedTexImage2D data
+		uint32_t internalFormat;
+		uint32_t format;		// pixel format of uncompressed payloads
+		uint32_t levels;
+	};
+
+	struct Level
+	{
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset;		// from the start of the file
+		uint64_t size;
+	};
+
+	static_assert(sizeof(Header) == 56, "texture cache header must have no padding");
+	static_assert(sizeof(Level) == 24, "texture cache level must have no padding");
+
+	// one level of a CPU side mip chain
+	struct Image
+	{
+		int width;
+		int height;
+		std::vector<unsigned char> pixels;
+	};
+
+	// size and modification time of a source file, false if it cannot be found
+	// ------------------------------------------------------------------------
+	inline bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time)
+	{
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			return false;
+		size = (uint64_t)info.st_size;
+		time = (int64_t)info.st_mtime;
+		return true;
+	}
+
+	// cache file name for a source image, flattened into the cache directory
+	// ------------------------------------------------------------------------
+	inline std::string cachePath(const std::string& directory, const std::string& path, bool flip)
+	{
+		std::string name = path;
+		for (size_t i = 0; i < name.size(); i++)
+		{
+			if (name[i] == '/' || name[i] == '\\' || name[i] == ':')
+				name[i] = '_';
+		}
+		return directory + "/" + name + (flip ? ".flip" : "") + ".vltx";
+	}
+
+	inline void ensureDirectory(const std::string& directory)
+	{
+#ifdef _WIN32
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+	}
+
+	// bytes per pixel of an uncompressed payload, 0 for formats the cache never writes
+	// ------------------------------------------------------------------------
+	inline uint64_t bytesPerPixel(uint32_t format)
+	{
+		switch (format)
+		{
+		case GL_RED:
+			return 1;
+		case GL_RG:
+			return 2;
+		case GL_RGB:
+			return 3;
+		case GL_RGBA:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	// checks that a mapped cache file is complete and still matches its source image.
+	// uncompressed levels must hold exactly width x height pixels (rows are unpacked with
+	// an alignment of 1), so glTexImage2D never reads past the end of the mapping
+	// ------------------------------------------------------------------------
+	inline bool validate(const MappedFile& file, uint64_t sourceSize, int64_t sourceTime, bool flip)
+	{
+		if (file.size() < sizeof(Header))
+			return false;
+		const Header* header = (const Header*)file.data();
+		if (header->magic[0] != 'V' || header->magic[1] != 'L' || header->magic[2] != 'T' || header->magic[3] != 'X')
+			return false;
+		if (header->version != VERSION || header->sourceSize != sourceSize || header->sourceTime != sourceTime)
+			return false;
+		if (header->flip != (flip ? 1u : 0u) || header->levels == 0 || header->levels > 32)
+			return false;
+		if (file.size() < sizeof(Header) + header->levels * sizeof(Level))
+			return false;
+		const uint64_t pixelBytes = header->compressed ? 0 : bytesPerPixel(header->format);
+		if (!header->compressed && pixelBytes == 0)
+			return false;
+		const Level* levels = (const Level*)(file.data() + sizeof(Header));
+		for (uint32_t i = 0; i < header->levels; i++)
+		{
+			if (levels[i].width == 0 || levels[i].height == 0 || levels[i].width > header->width || levels[i].height > header->height)
+				return false;
+			if (!header->compressed && levels[i].size != (uint64_t)levels[i].width * levels[i].height * pixelBytes)
+				return false;
+			if (levels[i].offset > file.size() || levels[i].size > file.size() - levels[i].offset)
+				return false;
+		}
+		return true;
+	}
+
+	// a temporary name next to path that no other writer, thread or process, uses
+	// ------------------------------------------------------------------------
+	inline std::string temporaryPath(const std::string& path)
+	{
+		static std::atomic<unsigned int> counter(0);
+#ifdef _WIN32
+		const int process = _getpid();
+#else
+		const int process = (int)getpid();
+#endif
+		return path + "." + std::to_string(process) + "." + std::to_string(counter++) + ".tmp";
+	}
+
+	// writes header, level table and payloads; goes through a temporary file of its own so
+	// a crash or a concurrent writer never leaves a truncated cache entry behind
+	// ------------------------------------------------------------------------
+	inline bool write(const std::string& path, Header header, const std::vector<Level>& levels, const std::vector<const unsigned char*>& payloads)
+	{
+		header.magic[0] = 'V';
+		header.magic[1] = 'L';
+		header.magic[2] = 'T';
+		header.magic[3] = 'X';
+		header.version = VERSION;
+		header.levels = (uint32_t)levels.size();
+
+		std::vector<Level> table(levels);
+		uint64_t offset = sizeof(Header) + table.size() * sizeof(Level);
+		for (size_t i = 0; i < table.size(); i++)
+		{
+			table[i].offset = offset;
+			offset += table[i].size;
+		}
+
+		std::string temporary = temporaryPath(path);
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (!file)
+			return false;
+		bool ok = fwrite(&header, sizeof(Header), 1, file) == 1;
+		ok = ok && fwrite(&table[0], sizeof(Level), table.size(), file) == table.size();
+		for (size_t i = 0; ok && i < table.size(); i++)
+			ok = fwrite(payloads[i], 1, (size_t)table[i].size, file) == table[i].size;
+		ok = (fclose(file) == 0) && ok;
+
+		if (ok)
+		{
+			remove(path.c_str());
+			ok = rename(temporary.c_str(), path.c_str()) == 0;
+		}
+		if (!ok)
+			remove(temporary.c_str());
+		return ok;
+	}
+
+	// box filters base down to 1x1, base becomes level 0 of chain
+	// ------------------------------------------------------------------------
+	inline void buildMipChain(Image& base, int components, std::vector<Image>& chain)
+	{
+		chain.clear();
+		chain.push_back(Image());
+		chain.back().width = base.width;
+		chain.back().height = base.height;
+		chain.back().pixels.swap(base.pixels);
+
+		while (chain.back().width > 1 || chain.back().height > 1)
+		{
+			const Image& src = chain.back();
+			Image dst;
+			dst.width = std::max(1, src.width / 2);
+			dst.height = std::max(1, src.height / 2);
+			dst.pixels.resize((size_t)dst.width * dst.height * components);
+			for (int y = 0; y < dst.height; y++)
+			{
+				int y0 = std::min(2 * y, src.height - 1);
+				int y1 = std::min(2 * y + 1, src.height - 1);
+				for (int x = 0; x < dst.width; x++)
+				{
+					int x0 = std::min(2 * x, src.width - 1);
+					int x1 = std::min(2 * x + 1, src.width - 1);
+					for (int c = 0; c < components; c++)
+					{
+						int sum = src.pixels[((size_t)y0 * src.width + x0) * components + c]
+							+ src.pixels[((size_t)y0 * src.width + x1) * components + c]
+							+ src.pixels[((size_t)y1 * src.width + x0) * components + c]
+							+ src.pixels[((size_t)y1 * src.width + x1) * components + c];
+						dst.pixels[((size_t)y * dst.width + x) * components + c] = (unsigned char)((sum + 2) / 4);
+					}
+				}
+			}
+			chain.push_back(Image());
+			chain.back().width = dst.width;
+			chain.back().height = dst.height;
+			chain.back().pixels.swap(dst.pixels);
+		}
+	}
+}
+
+#endif
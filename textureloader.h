@@ -0,0 +1,594 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+
+#include "stb_image.h"
+
+#include "mappedfile.h"
+#include "texturecache.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// sampler state and decode options for a texture requested from the TextureLoader
+struct TextureOptions
+{
+	GLint wrap;
+	GLint minFilter;
+	GLint magFilter;
+	bool flipVertically;
+
+	TextureOptions(GLint wrap = GL_REPEAT, GLint minFilter = GL_LINEAR, GLint magFilter = GL_LINEAR, bool flipVertically = true)
+		: wrap(wrap), minFilter(minFilter), magFilter(magFilter), flipVertically(flipVertically)
+	{
+	}
+
+	bool operator<(const TextureOptions& other) const
+	{
+		if (wrap != other.wrap) return wrap < other.wrap;
+		if (minFilter != other.minFilter) return minFilter < other.minFilter;
+		if (magFilter != other.magFilter) return magFilter < other.magFilter;
+		return flipVertically < other.flipVertically;
+	}
+};
+
+// decodes images on a pool of worker threads and uploads them to GL on the thread that
+// owns the context. load() hands out the texture name right away; the storage is filled
+// in by pump() once the decode has finished. identical requests share one texture.
+//
+// with a cache directory set, every texture is also written to a texture_cache file with
+// its full mip chain; later runs map that file and upload the levels directly, and only
+// decode the source image again once it is newer than the cache. the files are written by
+// the workers, never on the GL thread.
+//
+// compressCache has the driver block-compress the levels and caches what it produced. the
+// compression itself still happens inside glTexImage2D on the GL thread, so it is off by
+// default; the compressed levels are copied into a pixel buffer and only mapped once that
+// copy has finished, a later pump() then hands them to a worker
+class TextureLoader
+{
+public:
+	explicit TextureLoader(unsigned int numThreads = 0, const std::string& cacheDirectory = "", bool compressCache = false)
+		: stopping(false), pending(0), pbo(0), cacheDirectory(cacheDirectory), compressCache(compressCache), cacheHits(0)
+	{
+		if (!cacheDirectory.empty())
+			texture_cache::ensureDirectory(cacheDirectory);
+		if (numThreads == 0)
+			numThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int i = 0; i < numThreads; i++)
+			workers.push_back(std::thread(&TextureLoader::workerLoop, this));
+	}
+
+	~TextureLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		jobAvailable.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	// queues path for decoding and returns the GL texture it will be uploaded into
+	// ------------------------------------------------------------------------
+	unsigned int load(const std::string& path, const TextureOptions& options = TextureOptions())
+	{
+		Key key(path, options);
+		std::map<Key, unsigned int>::iterator it = textures.find(key);
+		if (it != textures.end())
+			return it->second;
+
+		unsigned int textureID;
+		glGenTextures(1, &textureID);
+		textures[key] = textureID;
+
+		Job job;
+		job.path = path;
+		job.options = options;
+		job.textureID = textureID;
+		job.components = 0;
+		job.sourceSize = 0;
+		job.sourceTime = 0;
+		job.skipCache = false;
+		job.cacheFormat = 0;
+		job.compressed = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(std::move(job));
+			pending++;
+		}
+		jobAvailable.notify_one();
+		return textureID;
+	}
+
+	// uploads every image decoded since the last call and collects finished readbacks of
+	// compressed levels; must run on the GL thread
+	// ------------------------------------------------------------------------
+	int pump()
+	{
+		std::vector<Job> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ready.swap(finished);
+		}
+		for (size_t i = 0; i < ready.size(); i++)
+			upload(ready[i]);
+		collectReadbacks();
+		return (int)ready.size();
+	}
+
+	// blocks until every queued texture has been decoded and uploaded
+	// ------------------------------------------------------------------------
+	void finish()
+	{
+		while (!done())
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobFinished.wait(lock, [this] { return !finished.empty() || pending == 0; });
+			}
+			pump();
+		}
+	}
+
+	// true once nothing is left to decode, upload or read back; must run on the GL thread
+	// ------------------------------------------------------------------------
+	bool done()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return pending == 0 && readbacks.empty();
+	}
+
+	// called on the GL thread with the texture name after each successful upload
+	// ------------------------------------------------------------------------
+	void setUploadCallback(const std::function<void(unsigned int)>& callback)
+	{
+		uploadCallback = callback;
+	}
+
+	// forgets an uploaded texture whose name the caller deleted or took over, so a later
+	// load() of the same file creates a new texture instead of returning the dead name
+	// ------------------------------------------------------------------------
+	void release(unsigned int textureID)
+	{
+		for (std::map<Key, unsigned int>::iterator it = textures.begin(); it != textures.end(); )
+		{
+			if (it->second == textureID)
+				it = textures.erase(it);
+			else
+				++it;
+		}
+	}
+
+	// number of textures that were served from the cache instead of being decoded
+	// ------------------------------------------------------------------------
+	int getCacheHits() const
+	{
+		return cacheHits;
+	}
+
+	// frees the staging buffer and drops unfinished readbacks; the textures themselves
+	// belong to the caller
+	// ------------------------------------------------------------------------
+	void deleteBuffers()
+	{
+		if (pbo != 0)
+			glDeleteBuffers(1, &pbo);
+		pbo = 0;
+		for (size_t i = 0; i < readbacks.size(); i++)
+		{
+			glDeleteSync(readbacks[i].fence);
+			glDeleteBuffers(1, &readbacks[i].pbo);
+		}
+		readbacks.clear();
+	}
+
+private:
+	typedef std::pair<std::string, TextureOptions> Key;
+
+	struct Job
+	{
+		std::string path;
+		TextureOptions options;
+		unsigned int textureID;
+		std::shared_ptr<MappedFile> cache;			// valid cache file, uploaded as is
+		std::vector<texture_cache::Image> mips;		// otherwise the decoded mip chain
+		int components;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		bool skipCache;
+
+		// set for cache writes handed back to the workers
+		GLint cacheFormat;
+		bool compressed;		// payload is blocks rather than mips
+		std::vector<std::vector<unsigned char> > blocks;
+	};
+
+	// the compressed levels of an uploaded texture on their way into a pixel pack buffer
+	struct Readback
+	{
+		Job job;
+		unsigned int pbo;
+		GLsync fence;
+		std::vector<size_t> sizes;
+	};
+
+	void workerLoop()
+	{
+		for (;;)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				jobAvailable.wait(lock, [this] { return stopping || !jobs.empty() || !cacheWrites.empty(); });
+				// cache writes are finished before stopping, decodes no longer matter then
+				if (!cacheWrites.empty())
+				{
+					job = std::move(cacheWrites.front());
+					cacheWrites.pop_front();
+				}
+				else if (stopping)
+					return;
+				else
+				{
+					job = std::move(jobs.front());
+					jobs.pop_front();
+				}
+			}
+
+			if (job.cacheFormat != 0)
+			{
+				writeCache(job, job.cacheFormat, job.compressed, job.blocks);
+				continue;
+			}
+
+			process(job);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				finished.push_back(std::move(job));
+			}
+			jobFinished.notify_all();
+		}
+	}
+
+	// runs on a worker: maps a fresh cache file, or decodes the source and builds its mips
+	void process(Job& job)
+	{
+		bool stamped = texture_cache::sourceStamp(job.path, job.sourceSize, job.sourceTime);
+		if (stamped && !cacheDirectory.empty() && !job.skipCache)
+		{
+			std::shared_ptr<MappedFile> file(new MappedFile());
+			if (file->open(texture_cache::cachePath(cacheDirectory, job.path, job.options.flipVertically))
+				&& texture_cache::validate(*file, job.sourceSize, job.sourceTime, job.options.flipVertically))
+			{
+				job.cache = file;
+				return;
+			}
+		}
+
+		texture_cache::Image base;
+		unsigned char* data = stbi_load(job.path.c_str(), &base.width, &base.height, &job.components, 0);
+		if (!data)
+			return;
+		base.pixels.assign(data, data + (size_t)base.width * base.height * job.components);
+		stbi_image_free(data);
+		if (job.options.flipVertically)
+			flipRows(&base.pixels[0], base.width, base.height, job.components);
+		texture_cache::buildMipChain(base, job.components, job.mips);
+
+		// raw cache files can be written right here; compressed ones need the driver
+		if (stamped && !cacheDirectory.empty() && !compressCache)
+			writeCache(job, formatFor(job.components), false, std::vector<std::vector<unsigned char> >());
+	}
+
+	// stb's flip flag is global state, so flipping is done here per image instead
+	static void flipRows(unsigned char* data, int width, int height, int nrComponents)
+	{
+		size_t stride = (size_t)width * nrComponents;
+		std::vector<unsigned char> row(stride);
+		for (int y = 0; y < height / 2; y++)
+		{
+			unsigned char* top = data + y * stride;
+			unsigned char* bottom = data + (height - 1 - y) * stride;
+			memcpy(&row[0], top, stride);
+			memcpy(top, bottom, stride);
+			memcpy(bottom, &row[0], stride);
+		}
+	}
+
+	static GLenum formatFor(int nrComponents)
+	{
+		if (nrComponents == 1)
+			return GL_RED;
+		if (nrComponents == 4)
+			return GL_RGBA;
+		return GL_RGB;
+	}
+
+	static GLenum compressedFormatFor(int nrComponents)
+	{
+		if (nrComponents == 1)
+			return GL_COMPRESSED_RED;
+		if (nrComponents == 4)
+			return GL_COMPRESSED_RGBA;
+		return GL_COMPRESSED_RGB;
+	}
+
+	void upload(Job& job)
+	{
+		glBindTexture(GL_TEXTURE_2D, job.textureID);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		int levels = 0;
+		if (job.cache)
+		{
+			levels = uploadCached(*job.cache);
+			if (levels == 0)
+			{
+				// the driver rejected the cached payload (e.g. a different GPU wrote it),
+				// so go back to the source image and rebuild the cache entry
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+				job.cache.reset();
+				job.skipCache = true;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					jobs.push_back(std::move(job));
+				}
+				jobAvailable.notify_one();
+				return;
+			}
+			cacheHits++;
+		}
+		else if (!job.mips.empty())
+		{
+			levels = uploadDecoded(job);
+		}
+		else
+		{
+			std::cout << "Texture failed to load at path: " << job.path << std::endl;
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		if (levels > 0)
+		{
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, job.options.wrap);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, job.options.wrap);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, job.options.minFilter);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, job.options.magFilter);
+			// queue the readback before the callback can hand the texture on
+			if (!job.cache && compressCache && !cacheDirectory.empty() && job.sourceSize != 0)
+				startReadback(job, levels);
+			if (uploadCallback)
+				uploadCallback(job.textureID);
+		}
+
+		job.mips.clear();
+		job.cache.reset();
+		std::lock_guard<std::mutex> lock(mutex);
+		pending--;
+	}
+
+	// uploads every level straight from the mapped cache file, returns 0 on GL errors
+	int uploadCached(const MappedFile& file)
+	{
+		const texture_cache::Header* header = (const texture_cache::Header*)file.data();
+		const texture_cache::Level* levels = (const texture_cache::Level*)(file.data() + sizeof(texture_cache::Header));
+
+		while (glGetError() != GL_NO_ERROR)
+			;
+		for (uint32_t i = 0; i < header->levels; i++)
+		{
+			const unsigned char* payload = file.data() + levels[i].offset;
+			if (header->compressed)
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, header->internalFormat, levels[i].width, levels[i].height, 0, (GLsizei)levels[i].size, payload);
+			else
+				glTexImage2D(GL_TEXTURE_2D, i, header->internalFormat, levels[i].width, levels[i].height, 0, header->format, GL_UNSIGNED_BYTE, payload);
+		}
+		return glGetError() == GL_NO_ERROR ? (int)header->levels : 0;
+	}
+
+	// uploads the CPU mip chain through a pixel buffer object so the driver can copy it
+	// asynchronously
+	int uploadDecoded(Job& job)
+	{
+		GLenum format = formatFor(job.components);
+		GLenum internalFormat = compressCache && !cacheDirectory.empty() ? compressedFormatFor(job.components) : format;
+
+		size_t total = 0;
+		for (size_t i = 0; i < job.mips.size(); i++)
+			total += job.mips[i].pixels.size();
+
+		if (pbo == 0)
+			glGenBuffers(1, &pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, total, NULL, GL_STREAM_DRAW);
+		unsigned char* staging = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (staging)
+		{
+			size_t offset = 0;
+			for (size_t i = 0; i < job.mips.size(); i++)
+			{
+				memcpy(staging + offset, &job.mips[i].pixels[0], job.mips[i].pixels.size());
+				offset += job.mips[i].pixels.size();
+			}
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		else
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		size_t offset = 0;
+		for (size_t i = 0; i < job.mips.size(); i++)
+		{
+			const texture_cache::Image& mip = job.mips[i];
+			const void* pixels = staging ? (const void*)offset : (const void*)&mip.pixels[0];
+			glTexImage2D(GL_TEXTURE_2D, (GLint)i, internalFormat, mip.width, mip.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+			offset += mip.pixels.size();
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return (int)job.mips.size();
+	}
+
+	// copies the levels the driver compressed into a pixel pack buffer without waiting for
+	// them and moves the job into readbacks; collectReadbacks() picks the copy up later.
+	// if the driver kept the levels uncompressed the decoded mips go to the cache instead
+	void startReadback(Job& job, int levels)
+	{
+		GLint isCompressed = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &isCompressed);
+		if (!isCompressed)
+		{
+			queueCacheWrite(job, formatFor(job.components), false);
+			return;
+		}
+
+		Readback readback;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &readback.job.cacheFormat);
+		size_t total = 0;
+		for (int i = 0; i < levels; i++)
+		{
+			GLint size = 0;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			readback.sizes.push_back((size_t)size);
+			total += (size_t)size;
+		}
+
+		glGenBuffers(1, &readback.pbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, total, NULL, GL_STREAM_READ);
+		size_t offset = 0;
+		for (int i = 0; i < levels; i++)
+		{
+			glGetCompressedTexImage(GL_TEXTURE_2D, i, (void*)offset);
+			offset += readback.sizes[i];
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		const GLint cacheFormat = readback.job.cacheFormat;
+		readback.job = std::move(job);
+		readback.job.cacheFormat = cacheFormat;
+		readbacks.push_back(std::move(readback));
+	}
+
+	// maps the readbacks whose copy has finished and queues their cache files; never waits
+	void collectReadbacks()
+	{
+		for (size_t i = 0; i < readbacks.size(); )
+		{
+			Readback& readback = readbacks[i];
+			// a zero timeout only polls; the flush makes sure the fence gets to signal
+			if (glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+			{
+				i++;
+				continue;
+			}
+			glDeleteSync(readback.fence);
+
+			size_t total = 0;
+			for (size_t level = 0; level < readback.sizes.size(); level++)
+				total += readback.sizes[level];
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+			const unsigned char* data = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, total, GL_MAP_READ_BIT);
+			if (data)
+			{
+				readback.job.blocks.resize(readback.sizes.size());
+				size_t offset = 0;
+				for (size_t level = 0; level < readback.sizes.size(); level++)
+				{
+					readback.job.blocks[level].assign(data + offset, data + offset + readback.sizes[level]);
+					offset += readback.sizes[level];
+				}
+				glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+				// keep what the driver produced, later runs skip both decode and compression
+				queueCacheWrite(readback.job, readback.job.cacheFormat, true);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			glDeleteBuffers(1, &readback.pbo);
+			readbacks.erase(readbacks.begin() + i);
+		}
+	}
+
+	// hands a cache file to the workers; job keeps its mips for an uncompressed one
+	void queueCacheWrite(Job& job, GLint cacheFormat, bool compressed)
+	{
+		job.cacheFormat = cacheFormat;
+		job.compressed = compressed;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cacheWrites.push_back(std::move(job));
+		}
+		jobAvailable.notify_one();
+	}
+
+	// blocks replaces the decoded mips as payload when the cache entry is compressed
+	void writeCache(const Job& job, GLenum internalFormat, bool compressed, const std::vector<std::vector<unsigned char> >& blocks)
+	{
+		texture_cache::Header header;
+		memset(&header, 0, sizeof(header));
+		header.sourceSize = job.sourceSize;
+		header.sourceTime = job.sourceTime;
+		header.width = job.mips[0].width;
+		header.height = job.mips[0].height;
+		header.components = job.components;
+		header.flip = job.options.flipVertically ? 1 : 0;
+		header.compressed = compressed ? 1 : 0;
+		header.internalFormat = internalFormat;
+		header.format = formatFor(job.components);
+
+		std::vector<texture_cache::Level> levels(job.mips.size());
+		std::vector<const unsigned char*> payloads(job.mips.size());
+		for (size_t i = 0; i < job.mips.size(); i++)
+		{
+			levels[i].width = job.mips[i].width;
+			levels[i].height = job.mips[i].height;
+			levels[i].offset = 0;
+			levels[i].size = compressed ? blocks[i].size() : job.mips[i].pixels.size();
+			payloads[i] = compressed ? &blocks[i][0] : &job.mips[i].pixels[0];
+		}
+
+		std::string path = texture_cache::cachePath(cacheDirectory, job.path, job.options.flipVertically);
+		if (!texture_cache::write(path, header, levels, payloads))
+			std::cout << "Failed to write texture cache: " << path << std::endl;
+	}
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobFinished;
+	std::deque<Job> jobs;
+	std::deque<Job> cacheWrites;
+	std::vector<Job> finished;
+	bool stopping;
+	int pending;
+
+	std::map<Key, unsigned int> textures;
+	unsigned int pbo;
+	std::vector<Readback> readbacks;	// GL thread only
+	std::function<void(unsigned int)> uploadCallback;
+
+	std::string cacheDirectory;
+	bool compressCache;
+	int cacheHits;
+};
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_HIERARCHY_SSE 1
+#endif
+
+// a scene graph of transform nodes in structure-of-arrays form: parents, child links,
+// local and world matrices and flags each live in their own array, indexed by node id.
+// changing a local transform only marks the node dirty; update() then recomputes the
+// world matrices of the dirty nodes and everything below them, one tree level at a time,
+// so every level is a run of independent 4x4 multiplies (SSE when available). static
+// subtrees are never visited and a frame without changes costs nothing
+class TransformHierarchy
+{
+public:
+	static const int ROOT = -1;
+
+	// adds a node below parent (ROOT for none); its world matrix is valid after update()
+	// ------------------------------------------------------------------------
+	int add(const glm::mat4& local, int parent = ROOT)
+	{
+		const int node = (int)parents.size();
+		parents.push_back(parent);
+		depths.push_back(parent == ROOT ? 0 : depths[parent] + 1);
+		firstChild.push_back(-1);
+		nextSibling.push_back(parent == ROOT ? -1 : firstChild[parent]);
+		if (parent != ROOT)
+			firstChild[parent] = node;
+		locals.push_back(local);
+		worlds.push_back(local);
+		flags.push_back(0);
+		markDirty(node);
+		return node;
+	}
+
+	void setLocal(int node, const glm::mat4& local)
+	{
+		locals[node] = local;
+		markDirty(node);
+	}
+
+	const glm::mat4& getLocal(int node) const
+	{
+		return locals[node];
+	}
+
+	const glm::mat4& getWorld(int node) const
+	{
+		return worlds[node];
+	}
+
+	int getParent(int node) const
+	{
+		return parents[node];
+	}
+
+	int size() const
+	{
+		return (int)parents.size();
+	}
+
+	// recomputes the world matrices of every dirty subtree; returns the nodes that
+	// changed, parents before children, or an empty list if nothing moved
+	// ------------------------------------------------------------------------
+	const std::vector<int>& update()
+	{
+		changed.clear();
+		if (dirtyNodes.empty())
+			return changed;
+
+		// gather the dirty subtrees by depth; a dirty node below another dirty node is
+		// reached through its ancestor as well and only queued once
+		for (size_t d = 0; d < levels.size(); d++)
+			levels[d].clear();
+		for (size_t i = 0; i < dirtyNodes.size(); i++)
+		{
+			stack.push_back(dirtyNodes[i]);
+			while (!stack.empty())
+			{
+				int node = stack.back();
+				stack.pop_back();
+				if (flags[node] & QUEUED)
+					continue;
+				flags[node] |= QUEUED;
+				if ((size_t)depths[node] >= levels.size())
+					levels.resize(depths[node] + 1);
+				levels[depths[node]].push_back(node);
+				for (int child = firstChild[node]; child >= 0; child = nextSibling[child])
+					stack.push_back(child);
+			}
+		}
+		dirtyNodes.clear();
+
+		// a level only depends on the one above it, which is already up to date
+		for (size_t d = 0; d < levels.size(); d++)
+		{
+			const std::vector<int>& level = levels[d];
+			for (size_t i = 0; i < level.size(); i++)
+			{
+				const int node = level[i];
+				if (parents[node] == ROOT)
+					worlds[node] = locals[node];
+				else
+					multiply(&worlds[parents[node]][0][0], &locals[node][0][0], &worlds[node][0][0]);
+				flags[node] = 0;
+				changed.push_back(node);
+			}
+		}
+		return changed;
+	}
+
+private:
+	enum Flags
+	{
+		DIRTY = 1,
+		QUEUED = 2
+	};
+
+	void markDirty(int node)
+	{
+		if (flags[node] & DIRTY)
+			return;
+		flags[node] |= DIRTY;
+		dirtyNodes.push_back(node);
+	}
+
+	// out = a * b for column major 4x4 matrices; out must not alias a or b
+	static void multiply(const float* a, const float* b, float* out)
+	{
+#ifdef TRANSFORM_HIERARCHY_SSE
+		const __m128 a0 = _mm_loadu_ps(a);
+		const __m128 a1 = _mm_loadu_ps(a + 4);
+		const __m128 a2 = _mm_loadu_ps(a + 8);
+		const __m128 a3 = _mm_loadu_ps(a + 12);
+		for (int j = 0; j < 4; j++)
+		{
+			// column j of the result mixes the columns of a by column j of b
+			__m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[4 * j]));
+			column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[4 * j + 1])));
+			column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[4 * j + 2])));
+			column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[4 * j + 3])));
+			_mm_storeu_ps(out + 4 * j, column);
+		}
+#else
+		for (int j = 0; j < 4; j++)
+		{
+			for (int i = 0; i < 4; i++)
+				out[4 * j + i] = a[i] * b[4 * j] + a[4 + i] * b[4 * j + 1] + a[8 + i] * b[4 * j + 2] + a[12 + i] * b[4 * j + 3];
+		}
+#endif
+	}
+
+	std::vector<int> parents;
+	std::vector<int> depths;
+	std::vector<int> firstChild;
+	std::vector<int> nextSibling;
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<uint8_t> flags;
+
+	std::vector<int> dirtyNodes;
+	std::vector<std::vector<int> > levels;	// per depth, the nodes to recompute
+	std::vector<int> stack;
+	std::vector<int> changed;
+};
+
+#endif